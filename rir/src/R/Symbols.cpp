@@ -11,6 +11,8 @@ DECLARE(AssignBracket, "[<-");
 DECLARE(AssignDoubleBracket, "[[<-");
 DECLARE(DoubleBracket, "[[");
 DECLARE(Bracket, "[");
+DECLARE(Dollar, "$");
+DECLARE(AssignDollar, "$<-");
 DECLARE(Block, "{");
 DECLARE(Parenthesis, "(");
 DECLARE(Assign, "<-");
@@ -34,6 +36,8 @@ DECLARE(Idiv, "%/%");
 DECLARE(Mod, "%%");
 DECLARE(Sqrt, "sqrt");
 DECLARE(Exp, "exp");
+DECLARE(Abs, "abs");
+DECLARE(Modulus, "Mod");
 DECLARE(Eq, "==");
 DECLARE(Ne, "!=");
 DECLARE(Lt, "<");
@@ -60,6 +64,7 @@ DECLARE(Or, "||");
 DECLARE(Missing, "missing");
 DECLARE(seq, "seq");
 DECLARE(lapply, "lapply");
+DECLARE(vapply, "vapply");
 DECLARE(aslist, "as.list");
 DECLARE(isvector, "is.vector");
 DECLARE(substr, "substr");
@@ -14,6 +14,8 @@ DECLARE(AssignBracket, "[<-");
 DECLARE(AssignDoubleBracket, "[[<-");
 DECLARE(DoubleBracket, "[[");
 DECLARE(Bracket, "[");
+DECLARE(Dollar, "$");
+DECLARE(AssignDollar, "$<-");
 DECLARE(Block, "{");
 DECLARE(Parenthesis, "(");
 DECLARE(Assign, "<-");
@@ -37,6 +39,8 @@ DECLARE(Idiv, "%/%");
 DECLARE(Mod, "%%");
 DECLARE(Sqrt, "sqrt");
 DECLARE(Exp, "exp");
+DECLARE(Abs, "abs");
+DECLARE(Modulus, "Mod");
 DECLARE(Eq, "==");
 DECLARE(Ne, "!=");
 DECLARE(Lt, "<");
@@ -63,6 +67,7 @@ DECLARE(Or, "||");
 DECLARE(Missing, "missing");
 DECLARE(seq, "seq");
 DECLARE(lapply, "lapply");
+DECLARE(vapply, "vapply");
 DECLARE(aslist, "as.list");
 DECLARE(isvector, "is.vector");
 DECLARE(substr, "substr");
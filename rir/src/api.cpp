@@ -9,6 +9,7 @@
 #include "ir/Compiler.h"
 #include "interpreter/interp_context.h"
 #include "interpreter/interp.h"
+#include "interpreter/thread_pool.h"
 #include "ir/BC.h"
 
 #include "utils/FunctionHandle.h"
@@ -175,6 +176,16 @@ REXPORT SEXP rir_eval(SEXP what, SEXP env) {
     return evalRirCode(functionCode(f), globalContext(), env, 0);
 }
 
+/** Sets the number of threads used for long vector operations, returns the
+ * previous setting.
+ */
+REXPORT SEXP rir_setThreads(SEXP threads) {
+    int n = Rf_asInteger(threads);
+    if (n == NA_INTEGER || n < 1)
+        Rf_error("number of threads must be a positive integer");
+    return Rf_ScalarInteger(setParallelThreads(n));
+}
+
 // debugging & internal purposes API only --------------------------------------
 
 /** Returns the constant pool object for inspection from R.
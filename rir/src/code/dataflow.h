@@ -410,10 +410,10 @@ class DataflowAnalysis
 
     void put_(CodeEditor::Iterator ins) override {
         int n = (*ins).immediate.i;
-        auto& v = current().top();
+        auto v = current().top();
         v.used(ins);
-        for (int i = 0; i < n - 1; i++)
-            current()[i] = current()[i + i];
+        for (int i = 0; i < n; i++)
+            current()[i] = current()[i + 1];
         current()[n] = v;
     }
 
@@ -505,6 +505,10 @@ class DataflowAnalysis
         current().push(v);
     }
 
+    void promise_(CodeEditor::Iterator ins) override {
+        current().push(FValue::Argument());
+    }
+
     void force_(CodeEditor::Iterator ins) override {
         current().push(forceProm(current().pop(), ins));
     }
@@ -512,12 +516,20 @@ class DataflowAnalysis
     void stvar_(CodeEditor::Iterator ins) override {
         SEXP sym = Pool::get((*ins).immediate.pool);
         auto v = current().pop();
-        // <- is eager, this has to be a value
-        if (!v.isValue())
+        // <- is eager, this has to be a value, unless we bind an argument of
+        // an inlined closure
+        if (v.t == FValue::Type::Argument)
+            v = FValue::Argument(sym);
+        else if (!v.isValue())
             v = FValue::Value(FValue::UseDef::multiuse());
         current()[sym] = v;
     }
 
+    void unbind_(CodeEditor::Iterator ins) override {
+        SEXP sym = Pool::get((*ins).immediate.pool);
+        current()[sym] = FValue::Absent();
+    }
+
     void call_(CodeEditor::Iterator ins) override {
         current().pop();
         // TODO we could be fancy and if its known whether fun is eager or lazy
@@ -526,6 +538,8 @@ class DataflowAnalysis
         current().push(FValue::Any(ins));
     }
 
+    void call_pic_(CodeEditor::Iterator ins) override { call_(ins); }
+
     void call_stack_(CodeEditor::Iterator ins) override {
         bool noProms = true;
         for (size_t i = 0; i < (*ins).immediate.call_args.nargs; ++i) {
@@ -592,6 +606,12 @@ class DataflowAnalysis
         current().push(FValue::Any(ins));
     }
 
+    void std_generic_(CodeEditor::Iterator ins) override {
+        // forces the signature arguments and calls the method
+        doCall(ins);
+        current().push(FValue::Any(ins));
+    }
+
     void guard_fun_(CodeEditor::Iterator ins) override {
         BC bc = *ins;
         SEXP sym = Pool::get(bc.immediate.guard_fun_args.name);
@@ -610,10 +630,10 @@ class DataflowAnalysis
 
     void pick_(CodeEditor::Iterator ins) override {
         int n = (*ins).immediate.i;
-        auto& v = current()[n];
+        auto v = current()[n];
         v.used(ins);
-        for (int i = 0; i < n - 1; i++)
-            current()[i + 1] = current()[i];
+        for (int i = n; i > 0; i--)
+            current()[i] = current()[i - 1];
         current().top() = v;
     }
 
@@ -665,6 +685,8 @@ class DataflowAnalysis
         case BC_t::isfun_:
         case BC_t::extract1_:
         case BC_t::subset1_:
+        case BC_t::dollar_:
+        case BC_t::extract_name_:
         case BC_t::extract2_:
         case BC_t::subset2_:
         case BC_t::close_:
@@ -0,0 +1,269 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "eval_cache.h"
+
+#define EVAL_CACHE_SLOTS 1024
+// Bytes of code and constants the cache may keep alive
+#define EVAL_CACHE_MAX_SIZE (16 * 1024 * 1024)
+// Larger expressions are only found by identity
+#define EVAL_CACHE_MAX_NODES 256
+// After that many misses in a row of expressions only found by identity,
+// only every EVAL_CACHE_SAMPLE-th of them is still cached
+#define EVAL_CACHE_MAX_MISSES 64
+#define EVAL_CACHE_SAMPLE 16
+
+/* The cache is direct mapped, an expression which is found by structure goes
+ * to the slot of its hash, any other to the slot of its address. In both
+ * cases the address points to the slot in byAddress, to save hashing the
+ * structure when the same expression comes again.
+ *
+ * C code tends to reuse calls, changing their arguments in place. Therefore
+ * an entry also has a copy of the cells of the expression as it was compiled,
+ * which even the same expression has to match.
+ *
+ * The entries vector has the expression, the copy and the code of a slot at
+ * ENTRY_SIZE * slot.
+ */
+enum { ENTRY_EXPR, ENTRY_COPY, ENTRY_CODE, ENTRY_SIZE };
+
+static SEXP entries = NULL;
+static unsigned byAddress[EVAL_CACHE_SLOTS];
+static uint64_t lastUse[EVAL_CACHE_SLOTS];
+static size_t entrySize[EVAL_CACHE_SLOTS];
+static size_t totalSize = 0;
+static uint64_t useCount = 0;
+static unsigned identityMisses = 0;
+
+static unsigned addressHash(SEXP e) {
+    return ((uintptr_t)e >> 4) * 2654435761u;
+}
+
+static unsigned mix(unsigned h, uintptr_t v) {
+    return (h ^ (unsigned)v ^ (unsigned)(v >> 32)) * 16777619u;
+}
+
+// Scalar constants without attributes
+static bool isScalarLeaf(SEXP e) {
+    switch (TYPEOF(e)) {
+    case LGLSXP:
+    case INTSXP:
+    case REALSXP:
+    case CPLXSXP:
+    case STRSXP:
+        return XLENGTH(e) == 1 && ATTRIB(e) == R_NilValue;
+    default:
+        return false;
+    }
+}
+
+static size_t scalarSize(SEXP e) {
+    switch (TYPEOF(e)) {
+    case LGLSXP:
+    case INTSXP:
+        return sizeof(int);
+    case REALSXP:
+        return sizeof(double);
+    case CPLXSXP:
+        return sizeof(Rcomplex);
+    default:
+        return 0;
+    }
+}
+
+/** Hashes the structure of calls of symbols and scalars. Returns false if
+  the expression is anything else, or too large.
+ */
+static bool structureHash(SEXP e, unsigned* h, unsigned* nodes) {
+    if (++*nodes > EVAL_CACHE_MAX_NODES)
+        return false;
+    *h = mix(*h, TYPEOF(e));
+    switch (TYPEOF(e)) {
+    case NILSXP:
+    case SYMSXP:
+        *h = mix(*h, (uintptr_t)e);
+        return true;
+    case LANGSXP:
+    case LISTSXP:
+        if (ATTRIB(e) != R_NilValue)
+            return false;
+        for (; e != R_NilValue; e = CDR(e)) {
+            if (TYPEOF(e) != LANGSXP && TYPEOF(e) != LISTSXP)
+                return false;
+            *h = mix(*h, (uintptr_t)TAG(e));
+            if (!structureHash(CAR(e), h, nodes))
+                return false;
+        }
+        return true;
+    default:
+        if (!isScalarLeaf(e))
+            return false;
+        if (TYPEOF(e) == STRSXP) {
+            *h = mix(*h, (uintptr_t)STRING_ELT(e, 0));
+        } else {
+            const unsigned char* p = (const unsigned char*)DATAPTR(e);
+            for (size_t i = 0; i < scalarSize(e); ++i)
+                *h = mix(*h, p[i]);
+        }
+        return true;
+    }
+}
+
+static bool isCells(SEXP e) {
+    return TYPEOF(e) == LANGSXP || TYPEOF(e) == LISTSXP;
+}
+
+// Copies the cells of calls and lists, sharing everything else
+static SEXP copyCells(SEXP e) {
+    if (!isCells(e))
+        return e;
+    SEXP res = PROTECT(CONS(R_NilValue, R_NilValue));
+    SEXP last = res;
+    for (; isCells(e); e = CDR(e)) {
+        SEXP car = PROTECT(copyCells(CAR(e)));
+        SEXP cell = TYPEOF(e) == LANGSXP ? LCONS(car, R_NilValue)
+                                         : CONS(car, R_NilValue);
+        UNPROTECT(1);
+        SETCDR(last, cell);
+        SET_TAG(cell, TAG(e));
+        SET_ATTRIB(cell, ATTRIB(e));
+        last = cell;
+    }
+    SETCDR(last, e);
+    UNPROTECT(1);
+    return CDR(res);
+}
+
+// Bytes of the vectors in the expression, which the cache keeps alive
+static size_t constantsSize(SEXP e) {
+    size_t size = 0;
+    for (; isCells(e); e = CDR(e))
+        size += constantsSize(CAR(e));
+    switch (TYPEOF(e)) {
+    case LGLSXP:
+    case INTSXP:
+        return size + XLENGTH(e) * sizeof(int);
+    case REALSXP:
+        return size + XLENGTH(e) * sizeof(double);
+    case CPLXSXP:
+        return size + XLENGTH(e) * sizeof(Rcomplex);
+    case RAWSXP:
+        return size + XLENGTH(e);
+    case STRSXP:
+    case VECSXP:
+    case EXPRSXP:
+        return size + XLENGTH(e) * sizeof(SEXP);
+    default:
+        return size;
+    }
+}
+
+/** Structural equality of calls and lists, for the scalars structureHash
+  accepts by value, for anything else by identity.
+ */
+static bool sameStructure(SEXP a, SEXP b) {
+    if (a == b)
+        return true;
+    if (TYPEOF(a) != TYPEOF(b))
+        return false;
+    switch (TYPEOF(a)) {
+    case LANGSXP:
+    case LISTSXP:
+        for (; TYPEOF(a) == LANGSXP || TYPEOF(a) == LISTSXP;
+             a = CDR(a), b = CDR(b))
+            if (TYPEOF(a) != TYPEOF(b) || TAG(a) != TAG(b) ||
+                ATTRIB(a) != ATTRIB(b) || !sameStructure(CAR(a), CAR(b)))
+                return false;
+        return a == b;
+    default:
+        if (!isScalarLeaf(a) || !isScalarLeaf(b))
+            return false;
+        if (TYPEOF(a) == STRSXP)
+            return STRING_ELT(a, 0) == STRING_ELT(b, 0);
+        // Compares the bits, ie. NA and NaN are not the same
+        return !memcmp(DATAPTR(a), DATAPTR(b), scalarSize(a));
+    }
+}
+
+static SEXP entry(unsigned slot, int what) {
+    return VECTOR_ELT(entries, ENTRY_SIZE * slot + what);
+}
+
+static void setEntry(unsigned slot, int what, SEXP value) {
+    SET_VECTOR_ELT(entries, ENTRY_SIZE * slot + what, value);
+}
+
+static void evict(unsigned slot) {
+    for (int i = 0; i < ENTRY_SIZE; ++i)
+        setEntry(slot, i, R_NilValue);
+    totalSize -= entrySize[slot];
+    entrySize[slot] = 0;
+}
+
+static void evictLeastRecentlyUsed() {
+    unsigned victim = EVAL_CACHE_SLOTS;
+    for (unsigned i = 0; i < EVAL_CACHE_SLOTS; ++i)
+        if (entrySize[i] &&
+            (victim == EVAL_CACHE_SLOTS || lastUse[i] < lastUse[victim]))
+            victim = i;
+    if (victim != EVAL_CACHE_SLOTS)
+        evict(victim);
+}
+
+static SEXP hit(unsigned slot) {
+    lastUse[slot] = ++useCount;
+    return entry(slot, ENTRY_CODE);
+}
+
+SEXP evalCacheCompile(SEXP expr, Context* ctx) {
+    if (!entries) {
+        entries = allocVector(VECSXP, ENTRY_SIZE * EVAL_CACHE_SLOTS);
+        R_PreserveObject(entries);
+    }
+
+    unsigned address = addressHash(expr) % EVAL_CACHE_SLOTS;
+    unsigned slot = byAddress[address];
+    if (slot && entry(slot - 1, ENTRY_EXPR) == expr &&
+        sameStructure(entry(slot - 1, ENTRY_COPY), expr)) {
+        identityMisses = 0;
+        return hit(slot - 1);
+    }
+
+    unsigned h = 2166136261u;
+    unsigned nodes = 0;
+    bool structural = structureHash(expr, &h, &nodes);
+    slot = structural ? h % EVAL_CACHE_SLOTS : address;
+    if (structural && entrySize[slot] &&
+        sameStructure(entry(slot, ENTRY_COPY), expr)) {
+        byAddress[address] = slot + 1;
+        return hit(slot);
+    }
+
+    SEXP code = PROTECT(ctx->compiler(expr));
+
+    // Calls which are built anew for every evaluation never hit, there is no
+    // point in keeping them and whatever data they refer to
+    bool insert = true;
+    if (!structural) {
+        ++identityMisses;
+        insert = identityMisses <= EVAL_CACHE_MAX_MISSES ||
+                 identityMisses % EVAL_CACHE_SAMPLE == 0;
+    }
+
+    size_t size = XLENGTH(code) * sizeof(int) + constantsSize(expr);
+    if (insert && size <= EVAL_CACHE_MAX_SIZE) {
+        if (entrySize[slot])
+            evict(slot);
+        while (totalSize + size > EVAL_CACHE_MAX_SIZE)
+            evictLeastRecentlyUsed();
+        setEntry(slot, ENTRY_COPY, copyCells(expr));
+        setEntry(slot, ENTRY_EXPR, expr);
+        setEntry(slot, ENTRY_CODE, code);
+        entrySize[slot] = size;
+        totalSize += size;
+        lastUse[slot] = ++useCount;
+        byAddress[address] = slot + 1;
+    }
+    UNPROTECT(1);
+    return code;
+}
@@ -0,0 +1,24 @@
+#ifndef RIR_INTERPRETER_EVAL_CACHE_H
+#define RIR_INTERPRETER_EVAL_CACHE_H
+
+#include "interp_context.h"
+
+/** Cache of the code rirEval compiles for expressions.
+
+  Lookups are by identity of the expression first. Expressions which are
+  small trees of symbols and scalars are also found by their structure, eg.
+  when the same text gets parsed over and over again.
+
+  The cache keeps the expressions it has code for alive, since GNU R can
+  only weakly reference environments and external pointers, and without the
+  expression the identity lookup would not be safe. Therefore the cache is
+  bounded in the number of entries and in the size of the code and of the
+  vectors in the expressions, evicting the least recently used entries. Once
+  expressions keep missing by identity, eg. calls built anew for every
+  evaluation, only a sample of them is cached.
+ */
+
+/** Returns the code for the expression, compiling it if not cached. */
+C_OR_CPP SEXP evalCacheCompile(SEXP expr, Context* ctx);
+
+#endif
@@ -6,6 +6,10 @@
 #include "runtime.h"
 #include "R/Funtab.h"
 #include "interpreter/deoptimizer.h"
+#include "interpreter/eval_cache.h"
+#include "interpreter/native_builtins.h"
+#include "interpreter/trace.h"
+#include "interpreter/vector_kernels.h"
 
 #define NOT_IMPLEMENTED assert(false)
 
@@ -18,7 +22,11 @@ extern SEXP R_TrueValue;
 extern SEXP R_FalseValue;
 extern SEXP Rf_NewEnvironment(SEXP, SEXP, SEXP);
 extern Rboolean R_Visible;
+extern int R_PPStackTop;
 
+#include <complex.h>
+#include <float.h>
+#include <limits.h>
 #include <setjmp.h>
 #include <signal.h>
 #define SIGJMP_BUF sigjmp_buf
@@ -147,18 +155,6 @@ INLINE SEXP createPromise(Code* code, SEXP env) {
 #endif
 }
 
-INLINE SEXP promiseValue(SEXP promise, Context * ctx) {
-    // if already evaluated, return the value
-    if (PRVALUE(promise) && PRVALUE(promise) != R_UnboundValue) {
-        promise = PRVALUE(promise);
-        assert(TYPEOF(promise) != PROMSXP);
-        SET_NAMED(promise, 2);
-        return promise;
-    } else {
-        return forcePromise(promise);
-    }
-}
-
 INLINE SEXP escape(SEXP val) {
     // FIXME : as long as our code objects can leak to various places
     // outside our control, we need to make sure to convert them back
@@ -173,6 +169,63 @@ extern RCNTXT* R_GlobalContext;
 extern void Rf_begincontext(void*, int, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern void Rf_endcontext(RCNTXT*);
 
+// Marks a promise whose evaluation is unwound as interrupted
+static void interruptPromise(void* promise) { SET_PRSEEN((SEXP)promise, 2); }
+
+/** Forces a promise of rir code on the current interpreter stack, instead of
+  going through GNU R's forcePromise, eval and the rirEval_f callback. The
+  checks are the ones of forcePromise in eval.c.
+
+  GNU R keeps the promises it forces in R_PendingPromises and marks the ones
+  a longjmp unwinds as interrupted (PRSEEN 2), but that list is not exported.
+  Instead the promise is forced in a C code context, whose cend marks it when
+  the context is unwound, as R_ExecWithCleanup does.
+ */
+static SEXP forceRirPromise(SEXP promise, Code* code, Context* ctx) {
+    if (PRSEEN(promise)) {
+        if (PRSEEN(promise) == 1)
+            error("promise already under evaluation: recursive default "
+                  "argument reference or earlier problems?");
+        // set PRSEEN to 1 to avoid infinite recursion
+        SET_PRSEEN(promise, 1);
+        warning("restarting interrupted promise evaluation");
+    }
+
+    RCNTXT cntxt;
+    Rf_begincontext(&cntxt, CTXT_CCODE, R_GlobalContext->call, R_BaseEnv,
+                    R_BaseEnv, R_NilValue, R_NilValue);
+    cntxt.cend = &interruptPromise;
+    cntxt.cenddata = promise;
+    SET_PRSEEN(promise, 1);
+
+    SEXP val = escape(evalRirCode(code, ctx, PRENV(promise), 0));
+
+    Rf_endcontext(&cntxt);
+    SET_PRSEEN(promise, 0);
+    SET_PRVALUE(promise, val);
+    SET_NAMED(val, 2);
+    SET_PRENV(promise, R_NilValue);
+    return val;
+}
+
+INLINE SEXP promiseValue(SEXP promise, Context * ctx) {
+    // if already evaluated, return the value
+    if (PRVALUE(promise) && PRVALUE(promise) != R_UnboundValue) {
+        promise = PRVALUE(promise);
+        assert(TYPEOF(promise) != PROMSXP);
+        SET_NAMED(promise, 2);
+        return promise;
+    }
+    Code* code = isValidPromiseSEXP(promise);
+    if (code)
+        return forceRirPromise(promise, code, ctx);
+    return forcePromise(promise);
+}
+
+#define IS_SCALAR_VALUE(e, type)                                               \
+    (TYPEOF(e) == type && SHORT_VEC_LENGTH(e) == 1 && ATTRIB(e) == R_NilValue)
+
+
 // TODO remove numArgs and bp -- this is only needed for the on stack argument
 // handling
 #define INSTRUCTION(name)                                                      \
@@ -287,6 +340,14 @@ INSTRUCTION(ldarg_) {
     ostack_push(ctx, val);
 }
 
+/* Quickening: some generic instructions rewrite themselves in place into a
+ * specialized variant, after they saw what they do at that pc. The variants
+ * have the same immediates and guard their assumption, if it fails they turn
+ * back into the generic instruction and run that. The compiler never sees
+ * them, BC::decode returns the generic instruction.
+ */
+#define QUICKEN(pc, op) (*((pc) - sizeof(OpcodeT)) = (op))
+
 INSTRUCTION(ldvar_) {
     SEXP sym = readConst(ctx, pc);
     SEXP val = findVar(sym, env);
@@ -368,6 +429,73 @@ SEXP createArgsListStack(Code* c, size_t nargs, CallSiteStruct* cs, SEXP env,
     return result;
 }
 
+/** The immediate of a promise which is a single push_, ldvar_ or ldarg_, and
+  the opcode in op. Returns NULL for any other promise.
+ */
+INLINE SEXP simpleArg(Code* arg, Opcode* op, Context* ctx) {
+    if (arg->codeSize != 2 * sizeof(OpcodeT) + sizeof(Immediate))
+        return NULL;
+    OpcodeT* pc = code(arg);
+    *op = (Opcode)*pc;
+    if ((*op != push_ && *op != ldvar_ && *op != ldarg_) ||
+        pc[1 + sizeof(Immediate)] != ret_)
+        return NULL;
+    return cp_pool_at(ctx, *(Immediate*)(pc + 1));
+}
+
+// From Defn.h
+#define ACTIVE_BINDING_MASK (1 << 15)
+#define IS_ACTIVE_BINDING(b) (LEVELS(b) & ACTIVE_BINDING_MASK)
+
+/** The promise sym is bound to in the frame of env, if it is forced already.
+  Other frames we leave alone, looking there is what forcing is for. A missing
+  argument forced to its default is left alone as well, missing() in the callee
+  has to follow it to the caller.
+ */
+INLINE SEXP forcedArg(SEXP sym, SEXP env) {
+    if (DDVAL(sym) || HASHTAB(env) != R_NilValue)
+        return NULL;
+    for (SEXP f = FRAME(env); f != R_NilValue; f = CDR(f)) {
+        if (TAG(f) != sym)
+            continue;
+        SEXP val = CAR(f);
+        if (IS_ACTIVE_BINDING(f) || MISSING(f) || TYPEOF(val) != PROMSXP ||
+            PRVALUE(val) == R_UnboundValue)
+            return NULL;
+        return val;
+    }
+    return NULL;
+}
+
+/** Constant arguments are passed as they are, like GNU R does. For variables
+  bound to promises which are forced already, the argument is a promise of
+  the variable with the value set, thus substitute still sees the variable.
+  For any other argument this returns NULL, they need a promise of their code.
+ */
+INLINE SEXP argWithoutCode(Code* arg, SEXP env, Context* ctx, bool eager) {
+    Opcode op;
+    SEXP imm = simpleArg(arg, &op, ctx);
+    if (!imm)
+        return NULL;
+    // Symbols and calls in the arguments list are taken for asts
+    if (op == push_)
+        return TYPEOF(imm) == SYMSXP || TYPEOF(imm) == LANGSXP ||
+                       TYPEOF(imm) == PROMSXP
+                   ? NULL
+                   : imm;
+
+    SEXP forced = forcedArg(imm, env);
+    if (!forced)
+        return NULL;
+    SEXP val = PRVALUE(forced);
+    SET_NAMED(val, 2);
+    if (eager)
+        return val;
+    SEXP promise = mkPROMISE(imm, R_NilValue);
+    SET_PRVALUE(promise, val);
+    return promise;
+}
+
 SEXP createArgsList(Code* c, SEXP call, size_t nargs, CallSiteStruct* cs,
                     SEXP env, Context* ctx, bool eager) {
     SEXP result = R_NilValue;
@@ -397,8 +525,15 @@ SEXP createArgsList(Code* c, SEXP call, size_t nargs, CallSiteStruct* cs,
                         assert(TYPEOF(arg) != PROMSXP);
                         __listAppend(&result, &pos, arg, name);
                     } else {
-                        SEXP promise = mkPROMISE(CAR(ellipsis), env);
-                        __listAppend(&result, &pos, promise, name);
+                        // The promises of the ellipsis are passed on as
+                        // they are, wrapping them again would only build
+                        // chains of promises through wrapper functions.
+                        // missing() and substitute look through promises
+                        // anyway.
+                        SEXP arg = CAR(ellipsis);
+                        if (TYPEOF(arg) == SYMSXP || TYPEOF(arg) == LANGSXP)
+                            arg = mkPROMISE(arg, env);
+                        __listAppend(&result, &pos, arg, name);
                     }
                     ellipsis = CDR(ellipsis);
                 }
@@ -408,14 +543,17 @@ SEXP createArgsList(Code* c, SEXP call, size_t nargs, CallSiteStruct* cs,
                 Rf_errorcall(call, "argument %d is empty", i + 1);
             __listAppend(&result, &pos, R_MissingArg, R_NilValue);
         } else {
-            if (eager) {
-                SEXP arg = evalRirCode(codeAt(function(c), argi), ctx, env, 0);
+            Code* code = codeAt(function(c), argi);
+            SEXP arg = argWithoutCode(code, env, ctx, eager);
+            if (arg) {
+                __listAppend(&result, &pos, arg, name);
+            } else if (eager) {
+                arg = evalRirCode(code, ctx, env, 0);
                 arg = escape(arg);
                 assert(TYPEOF(arg) != PROMSXP);
                 __listAppend(&result, &pos, arg, name);
             } else {
-                Code* arg = codeAt(function(c), argi);
-                SEXP promise = createPromise(arg, env);
+                SEXP promise = createPromise(code, env);
                 __listAppend(&result, &pos, promise, name);
             }
         }
@@ -446,8 +584,12 @@ SEXP rirCallTrampoline(RCNTXT* cntxt, Code* code, SEXP env, unsigned nargs,
     return evalRirCode(code, ctx, env, nargs);
 }
 
-INLINE SEXP rirCallClosure(SEXP call, SEXP env, SEXP callee, SEXP actuals,
-                           unsigned nargs, OpcodeT** pc, Context* ctx) {
+/** Everything of a call to a rir closure up to running its code: optimizes the
+  function if it got hot, creates the environment and enters the R context.
+  The environment and the context are pushed on the stack.
+ */
+INLINE RCNTXT* rirEnterClosure(SEXP call, SEXP env, SEXP callee, SEXP actuals,
+                               Function** funOut, Context* ctx) {
 
     SEXP body = BODY(callee);
     Function* fun = (Function*)INTEGER(body);
@@ -482,6 +624,7 @@ INLINE SEXP rirCallClosure(SEXP call, SEXP env, SEXP callee, SEXP actuals,
             fun->invocationCount = oldFun->invocationCount + 1;
             fun->envLeaked = oldFun->envLeaked;
             fun->envChanged = oldFun->envChanged;
+            fun->traced = oldFun->traced;
 
             optimizing = false;
         } else if (fun->invocationCount < UINT_MAX)
@@ -506,11 +649,17 @@ INLINE SEXP rirCallClosure(SEXP call, SEXP env, SEXP callee, SEXP actuals,
     else
         Rf_begincontext(cntxt, CTXT_RETURN, call, newEnv, env, actuals, callee);
 
-    // Exec the closure
     closureDebug(call, callee, env, newEnv, cntxt);
-    Code* code = functionCode(fun);
+    *funOut = fun;
+    return cntxt;
+}
 
-    SEXP result = rirCallTrampoline(cntxt, code, newEnv, nargs, ctx);
+/** Ends a call started by rirEnterClosure. Leaves the environment and the
+  context on the stack.
+ */
+INLINE void rirLeaveClosure(SEXP call, SEXP env, SEXP callee, Function* fun,
+                            RCNTXT* cntxt, SEXP result, Context* ctx) {
+    SEXP newEnv = *ostack_at(ctx, 1);
 
     endClosureDebug(callee, call, env);
 
@@ -532,6 +681,19 @@ INLINE SEXP rirCallClosure(SEXP call, SEXP env, SEXP callee, SEXP actuals,
 
     if (fun->deopt)
         SET_BODY(callee, fun->origin);
+}
+
+INLINE SEXP rirCallClosure(SEXP call, SEXP env, SEXP callee, SEXP actuals,
+                           unsigned nargs, OpcodeT** pc, Context* ctx) {
+    Function* fun;
+    RCNTXT* cntxt = rirEnterClosure(call, env, callee, actuals, &fun, ctx);
+
+    // Exec the closure
+    Code* code = functionCode(fun);
+    SEXP result =
+        rirCallTrampoline(cntxt, code, *ostack_at(ctx, 1), nargs, ctx);
+
+    rirLeaveClosure(call, env, callee, fun, cntxt, result, ctx);
 
     ostack_pop(ctx); // cntxt
     ostack_pop(ctx); // newEnv
@@ -637,6 +799,8 @@ SEXP doCall(Code* caller, SEXP callee, unsigned nargs, unsigned id, SEXP env,
         SEXP argslist =
             createArgsList(caller, call, nargs, cs, env, ctx, false);
         PROTECT(argslist);
+        if (cs->forceFirstArg && TYPEOF(CAR(argslist)) == PROMSXP)
+            promiseValue(CAR(argslist), ctx);
 #if RIR_AS_PACKAGE == 0
         // if body is INTSXP, it is rir serialized code, execute it directly
         SEXP body = BODY(callee);
@@ -758,6 +922,17 @@ SEXP doCallStack(Code* caller, SEXP callee, size_t nargs, unsigned id, SEXP env,
         break;
     }
     case BUILTINSXP: {
+        // The native versions take the arguments right from the stack
+        NativeBuiltin native = cs->hasNames ? NULL : nativeBuiltin(callee);
+        if (native) {
+            res = native(nargs ? ostack_at(ctx, nargs - 1) : NULL, nargs);
+            if (res) {
+                ostack_popn(ctx, nargs);
+                R_Visible = TRUE;
+                break;
+            }
+        }
+
         SEXP argslist = createArgsListStack(caller, nargs, cs, env, ctx, true);
         PROTECT(argslist);
         ostack_popn(ctx, nargs);
@@ -807,12 +982,504 @@ SEXP doCallStack(Code* caller, SEXP callee, size_t nargs, unsigned id, SEXP env,
     return res;
 }
 
+/** Calls one of the closures cached at a call_pic_ site. They are all rir
+  closures, so there is no need to look at the callee again, nor to profile
+  the call.
+ */
+SEXP doCachedCall(Code* caller, SEXP callee, unsigned nargs, unsigned id,
+                  SEXP env, OpcodeT** pc, Context* ctx) {
+#if RIR_AS_PACKAGE == 0
+    if (!USE_RIR_CONTEXT_SETUP)
+        return doCall(caller, callee, nargs, id, env, pc, ctx);
+    CallSiteStruct* cs = CallSite_get(caller, id);
+    SEXP call = cp_pool_at(ctx, cs->call);
+    SEXP argslist = createArgsList(caller, call, nargs, cs, env, ctx, false);
+    PROTECT(argslist);
+    if (cs->forceFirstArg && TYPEOF(CAR(argslist)) == PROMSXP)
+        promiseValue(CAR(argslist), ctx);
+    SEXP result = rirCallClosure(call, env, callee, argslist, nargs, pc, ctx);
+    UNPROTECT(1);
+    return result;
+#else
+    return doCall(caller, callee, nargs, id, env, pc, ctx);
+#endif
+}
+
+#if RIR_AS_PACKAGE == 0
+/* Calls to rir closures from call_ and call_pic_ do not recurse in C, the
+ * interpreter loop saves the state of the caller in a frame and continues in
+ * the code of the callee (see evalRirCode). Calls from anywhere else, and
+ * calls into GNU R, still recurse.
+ */
+#define STACKLESS_CALLS 1
+
+// Stack slots left to calls which recurse in C
+#define STACKLESS_STACK_RESERVE 1024
+
+INLINE bool stacklessCallee(SEXP callee) {
+    if (TYPEOF(callee) != CLOSXP || TYPEOF(BODY(callee)) != INTSXP)
+        return false;
+    Code* code = functionCode((Function*)INTEGER(BODY(callee)));
+    return R_BCNodeStackTop + code->stackLength + STACKLESS_STACK_RESERVE <
+           R_BCNodeStackEnd;
+}
+
+/** Starts the call of the call_ or call_pic_ instruction at pc without
+  running the callee, which is on top of the stack. Its environment and
+  context are pushed above it. A longjmp to the context lands in jump.
+
+  Returns the new frame at depth, the caller fills in its own state.
+ */
+static Frame* stacklessCall(Code* caller, SEXP env, OpcodeT** pc, bool pic,
+                            size_t depth, JMP_BUF jump, Context* ctx) {
+    unsigned id = readImmediate(pc);
+    unsigned nargs = readImmediate(pc);
+    SEXP callee = ostack_top(ctx);
+    CallSiteStruct* cs = CallSite_get(caller, id);
+
+    // Closures cached at a call_pic_ site are not profiled again
+    bool cached = false;
+    if (pic) {
+        SEXP cache = cp_pool_at(ctx, *CallSite_inlineCache(cs));
+        for (int i = 0; i < LENGTH(cache) && !cached; ++i)
+            cached = VECTOR_ELT(cache, i) == callee;
+    }
+    if (!cached)
+        profileCall(cs, callee);
+
+    // The context records the protection stack with argslist on it
+    int ppStackTop = R_PPStackTop;
+    SEXP call = cp_pool_at(ctx, cs->call);
+    SEXP argslist = createArgsList(caller, call, nargs, cs, env, ctx, false);
+    PROTECT(argslist);
+    if (cs->forceFirstArg && TYPEOF(CAR(argslist)) == PROMSXP)
+        promiseValue(CAR(argslist), ctx);
+    Function* fun;
+    RCNTXT* cntxt = rirEnterClosure(call, env, callee, argslist, &fun, ctx);
+    UNPROTECT(1);
+    memcpy(cntxt->cjmpbuf, jump, sizeof(JMP_BUF));
+
+    ctx->frameCount = depth;
+    Frame* f = frame_push(ctx);
+    f->ppStackTop = ppStackTop;
+    f->call = call;
+    f->callee = callee;
+    f->fun = fun;
+    f->nargs = nargs;
+    f->cntxt = cntxt;
+    return f;
+}
+
+/** Finishes the call of the frame below depth with result. The stack has to
+  be back at the context of the callee. Returns the frame, the caller resumes
+  from it.
+ */
+static Frame* stacklessReturn(SEXP result, size_t depth, Context* ctx) {
+    Frame* f = &ctx->frames[depth - 1];
+    PROTECT(result);
+    rirLeaveClosure(f->call, f->env, f->callee, f->fun, (RCNTXT*)f->cntxt,
+                    result, ctx);
+    UNPROTECT(1);
+    ostack_popn(ctx, 3); // cntxt, newEnv, callee
+    ostack_push(ctx, result);
+    ctx->frameCount = depth - 1;
+    // on.exit code might have grown the frames
+    return &ctx->frames[depth - 1];
+}
+
+/** Drops the frames whose context is not on the R context stack anymore. An
+  error which unwinds past all rir activations, eg. to a tryCatch in GNU R
+  code, leaves them behind, since only an rir activation resets frameCount.
+  Live frames are below those.
+ */
+static bool frameLive(Frame* f) {
+    for (RCNTXT* c = R_GlobalContext; c; c = c->nextcontext)
+        if (c == f->cntxt)
+            return c->callfun == f->callee;
+    return false;
+}
+
+static void dropStaleFrames(Context* ctx) {
+    while (ctx->frameCount > 0 &&
+           !frameLive(&ctx->frames[ctx->frameCount - 1]))
+        ctx->frameCount--;
+}
+#else
+#define STACKLESS_CALLS 0
+#endif
+
 // Imports from GNUR for method dispatch
 SEXP R_possible_dispatch(SEXP call, SEXP op, SEXP args, SEXP rho,
                          Rboolean promisedArgs);
 Rboolean R_has_methods(SEXP selector);
 int Rf_usemethod(const char* generic, SEXP obj, SEXP call, SEXP args, SEXP rho,
                  SEXP callrho, SEXP defrho, SEXP* ans);
+SEXP R_LookupMethod(SEXP method, SEXP rho, SEXP callrho, SEXP defrho);
+SEXP R_execMethod(SEXP op, SEXP rho);
+const char* R_curErrorBuf();
+
+/* Entries of the S3 dispatch cache of a call site are lists of
+ *   the class attribute of the receiver,
+ *   the method names, in the order they are looked up, up to the one found,
+ *   the method, or R_NilValue if there is none,
+ *   and .Class for the method.
+ * There is no way to get notified when GNU R code defines or removes a
+ * method, therefore a hit looks the names up again. What we save is building
+ * the names and, if there is no method, setting up the context for
+ * usemethod.
+ */
+enum { S3_CLASS, S3_NAMES, S3_METHOD, S3_DOTCLASS, S3_ENTRY_SIZE };
+
+// CHARSXPs are cached, thus equal class names are the same CHARSXP
+static bool sameClass(SEXP a, SEXP b) {
+    if (a == b)
+        return true;
+    if (XLENGTH(a) != XLENGTH(b))
+        return false;
+    for (R_xlen_t i = 0; i < XLENGTH(a); ++i)
+        if (STRING_ELT(a, i) != STRING_ELT(b, i))
+            return false;
+    return true;
+}
+
+static bool s3EntryValid(SEXP entry, SEXP env) {
+    SEXP names = VECTOR_ELT(entry, S3_NAMES);
+    SEXP method = VECTOR_ELT(entry, S3_METHOD);
+    R_xlen_t n = XLENGTH(names);
+    R_xlen_t misses = method == R_NilValue ? n : n - 1;
+    for (R_xlen_t i = 0; i < misses; ++i)
+        if (isFunction(R_LookupMethod(VECTOR_ELT(names, i), env, env,
+                                      R_BaseEnv)))
+            return false;
+    return method == R_NilValue ||
+           R_LookupMethod(VECTOR_ELT(names, n - 1), env, env, R_BaseEnv) ==
+               method;
+}
+
+static SEXP s3MethodName(const char* generic, const char* klass) {
+    size_t len = strlen(generic) + strlen(klass) + 2;
+    char* name = R_alloc(len, 1);
+    snprintf(name, len, "%s.%s", generic, klass);
+    return Rf_install(name);
+}
+
+/** Does the lookup of usemethod. Returns NULL if the method is not a closure,
+  then we leave it to usemethod.
+ */
+static SEXP s3Lookup(const char* generic, SEXP klass, SEXP env) {
+    R_xlen_t n = XLENGTH(klass);
+    SEXP names = PROTECT(allocVector(VECSXP, n + 1));
+    SEXP method = R_NilValue;
+    R_xlen_t i = 0;
+    for (; i <= n; ++i) {
+        const void* vmax = vmaxget();
+        SEXP name = s3MethodName(
+            generic, i < n ? translateChar(STRING_ELT(klass, i)) : "default");
+        vmaxset(vmax);
+        SET_VECTOR_ELT(names, i, name);
+        SEXP m = R_LookupMethod(name, env, env, R_BaseEnv);
+        if (isFunction(m)) {
+            method = m;
+            break;
+        }
+    }
+    if (method != R_NilValue && TYPEOF(method) != CLOSXP) {
+        UNPROTECT(1);
+        return NULL;
+    }
+    PROTECT(method);
+    if (i < n)
+        names = Rf_lengthgets(names, i + 1);
+    PROTECT(names);
+
+    SEXP dotClass = R_NilValue;
+    if (i == 0) {
+        dotClass = klass;
+    } else if (i < n) {
+        dotClass = PROTECT(allocVector(STRSXP, n - i));
+        for (R_xlen_t j = i; j < n; ++j)
+            SET_STRING_ELT(dotClass, j - i, STRING_ELT(klass, j));
+        setAttrib(dotClass, install("previous"), klass);
+        UNPROTECT(1);
+    }
+    PROTECT(dotClass);
+
+    SEXP entry = allocVector(VECSXP, S3_ENTRY_SIZE);
+    SET_VECTOR_ELT(entry, S3_CLASS, klass);
+    SET_VECTOR_ELT(entry, S3_NAMES, names);
+    SET_VECTOR_ELT(entry, S3_METHOD, method);
+    SET_VECTOR_ELT(entry, S3_DOTCLASS, dotClass);
+    UNPROTECT(4);
+    return entry;
+}
+
+// Calls the method like dispatchMethod in GNU R does
+static SEXP s3Apply(SEXP entry, const char* generic, SEXP call, SEXP actuals,
+                    SEXP op, SEXP env, Context* ctx) {
+    SEXP method = VECTOR_ELT(entry, S3_METHOD);
+    SEXP names = VECTOR_ELT(entry, S3_NAMES);
+    SEXP name = VECTOR_ELT(names, XLENGTH(names) - 1);
+
+    SEXP vars = PROTECT(Rf_NewEnvironment(R_NilValue, R_NilValue, R_BaseEnv));
+    defineVar(install(".Generic"), mkString(generic), vars);
+    defineVar(install(".Class"), VECTOR_ELT(entry, S3_DOTCLASS), vars);
+    defineVar(install(".Method"), ScalarString(PRINTNAME(name)), vars);
+    defineVar(install(".GenericCallEnv"), env, vars);
+    defineVar(install(".GenericDefEnv"), R_BaseEnv, vars);
+
+    SEXP newcall = PROTECT(shallow_duplicate(call));
+    SETCAR(newcall, name);
+
+    char cntxt[400];
+    SEXP rho1 = Rf_NewEnvironment(R_NilValue, R_NilValue, env);
+    ostack_push(ctx, rho1);
+    initClosureContext(&cntxt, call, rho1, env, actuals, op);
+    R_GlobalContext->callflag = CTXT_GENERIC;
+    SEXP res = applyClosure(newcall, method, actuals, rho1, vars);
+    R_GlobalContext->callflag = CTXT_RETURN;
+    ostack_pop(ctx);
+    endClosureContext(&cntxt, res);
+    UNPROTECT(2);
+    return res;
+}
+
+/** S3 dispatch for the builtin generic of a dispatch site. Returns whether a
+  method was found, its result is stored in res.
+ */
+static bool dispatchS3(CallSiteStruct* cs, SEXP selector, SEXP op, SEXP obj,
+                       SEXP call, SEXP actuals, SEXP env, SEXP* res,
+                       Context* ctx) {
+    const char* generic = CHAR(PRINTNAME(selector));
+    SEXP klass = getAttrib(obj, R_ClassSymbol);
+
+    if (!IS_S4_OBJECT(obj) && TYPEOF(klass) == STRSXP) {
+        SEXP cache = cp_pool_at(ctx, *CallSite_dispatchCache(cs));
+        SEXP entry = NULL;
+        for (int i = 0; i < DISPATCH_CACHE_SIZE; ++i) {
+            SEXP e = VECTOR_ELT(cache, i);
+            if (e != R_NilValue && sameClass(VECTOR_ELT(e, S3_CLASS), klass) &&
+                s3EntryValid(e, env)) {
+                entry = e;
+                break;
+            }
+        }
+        if (!entry) {
+            entry = s3Lookup(generic, klass, env);
+            if (entry) {
+                for (int i = DISPATCH_CACHE_SIZE - 1; i > 0; --i)
+                    SET_VECTOR_ELT(cache, i, VECTOR_ELT(cache, i - 1));
+                SET_VECTOR_ELT(cache, 0, entry);
+            }
+        }
+        if (entry) {
+            if (VECTOR_ELT(entry, S3_METHOD) == R_NilValue)
+                return false;
+            *res = s3Apply(entry, generic, call, actuals, op, env, ctx);
+            return true;
+        }
+    }
+
+    char cntxt[400];
+    SEXP rho1 = Rf_NewEnvironment(R_NilValue, R_NilValue, env);
+    ostack_push(ctx, rho1);
+    initClosureContext(&cntxt, call, rho1, env, actuals, op);
+    bool success = Rf_usemethod(generic, obj, call, actuals, rho1, env,
+                                R_BaseEnv, res);
+    ostack_pop(ctx);
+    endClosureContext(&cntxt, success ? *res : R_NilValue);
+    return success;
+}
+
+/* Entries of the dispatch cache of a std_generic_ site are lists of
+ *   the environment of the generic,
+ *   the classes of the signature arguments, as a character vector,
+ *   the label of the method in the methods table of the generic,
+ *   and the method.
+ * setMethod and removeMethod reset the tables of the generic, thus a hit
+ * looks the label up again. What we save is finding the generic on the
+ * context stack and building the label.
+ */
+enum { S4_ENV, S4_CLASSES, S4_LABEL, S4_METHOD, S4_ENTRY_SIZE };
+
+// Signatures we deal with ourselves
+#define S4_MAX_SIGNATURE 8
+
+static SEXP s4DotGeneric, s4AllMTable, s4SigArgs, s4SigLength, s4Missing,
+    s4Target, s4Defined, s4NextMethod, s4GenericAttr, s4DotTarget, s4DotDefined,
+    s4DotNextMethod, s4DotMethod;
+
+static void initS4Symbols() {
+    if (s4DotGeneric)
+        return;
+    s4DotGeneric = install(".Generic");
+    s4AllMTable = install(".AllMTable");
+    s4SigArgs = install(".SigArgs");
+    s4SigLength = install(".SigLength");
+    s4Missing = mkChar("missing");
+    R_PreserveObject(s4Missing);
+    s4Target = install("target");
+    s4Defined = install("defined");
+    s4NextMethod = install("nextMethod");
+    s4GenericAttr = install("generic");
+    s4DotTarget = install(".target");
+    s4DotDefined = install(".defined");
+    s4DotNextMethod = install(".nextMethod");
+    s4DotMethod = install(".Method");
+}
+
+// The class R_dispatchGeneric selects on for a signature argument
+static SEXP s4ArgClass(SEXP sym, SEXP generic, SEXP env) {
+    R_varloc_t loc = R_findVarLocInFrame(env, sym);
+    if (R_VARLOC_IS_NULL(loc))
+        return NULL;
+    if (R_GetVarLocMISSING(loc))
+        return s4Missing;
+
+    int err;
+    SEXP arg = R_tryEvalSilent(sym, env, &err);
+    if (err)
+        error("error in evaluating the argument '%s' in selecting a method "
+              "for function '%s': %s",
+              CHAR(PRINTNAME(sym)), CHAR(PRINTNAME(generic)), R_curErrorBuf());
+    SEXP klass = getAttrib(arg, R_ClassSymbol);
+    if (TYPEOF(klass) == STRSXP && XLENGTH(klass) > 0)
+        return STRING_ELT(klass, 0);
+    return STRING_ELT(R_data_class(arg, TRUE), 0);
+}
+
+// Methods we can run without the help of the methods package, ie. closures
+// with no other attributes than the ones R_loadMethod deals with itself
+static bool s4Cachable(SEXP method) {
+    if (TYPEOF(method) != CLOSXP || inherits(method, "internalDispatchMethod"))
+        return false;
+    for (SEXP a = ATTRIB(method); a != R_NilValue; a = CDR(a)) {
+        SEXP t = TAG(a);
+        if (t != R_ClassSymbol && t != s4Target && t != s4Defined &&
+            t != s4NextMethod && t != R_SrcrefSymbol && t != s4GenericAttr)
+            return false;
+    }
+    return true;
+}
+
+// What R_loadMethod and R_dispatchGeneric do for the method
+static SEXP s4Apply(SEXP method, SEXP env) {
+    if (OBJECT(method)) {
+        for (SEXP a = ATTRIB(method); a != R_NilValue; a = CDR(a)) {
+            SEXP t = TAG(a);
+            if (t == s4Target)
+                defineVar(s4DotTarget, CAR(a), env);
+            else if (t == s4Defined)
+                defineVar(s4DotDefined, CAR(a), env);
+            else if (t == s4NextMethod)
+                defineVar(s4DotNextMethod, CAR(a), env);
+        }
+        defineVar(s4DotMethod, method, env);
+    }
+    return R_execMethod(method, env);
+}
+
+static SEXP s4Label(SEXP* classes, int n) {
+    size_t len = 0;
+    for (int i = 0; i < n; ++i)
+        len += strlen(CHAR(classes[i])) + 1;
+    char* label = R_alloc(len, 1);
+    char* pos = label;
+    for (int i = 0; i < n; ++i) {
+        if (i > 0)
+            *pos++ = '#';
+        strcpy(pos, CHAR(classes[i]));
+        pos += strlen(CHAR(classes[i]));
+    }
+    return install(label);
+}
+
+/** standardGeneric for the generic whose frame env is. Returns NULL if the
+  call has to go through standardGeneric instead.
+ */
+static SEXP dispatchS4(CallSiteStruct* cs, SEXP env, Context* ctx) {
+    initS4Symbols();
+    SEXP generic = cp_pool_at(ctx, *CallSite_selector(cs));
+
+    // If we are not in the frame of the generic, then standardGeneric has
+    // to find it on the context stack
+    SEXP fenv = ENCLOS(env);
+    SEXP name = findVarInFrame(fenv, s4DotGeneric);
+    if (TYPEOF(name) != STRSXP || XLENGTH(name) != 1 ||
+        STRING_ELT(name, 0) != PRINTNAME(generic))
+        return NULL;
+
+    SEXP table = findVarInFrame(fenv, s4AllMTable);
+    SEXP sigArgs = findVarInFrame(fenv, s4SigArgs);
+    SEXP sigLength = findVarInFrame(fenv, s4SigLength);
+    if (TYPEOF(table) != ENVSXP || TYPEOF(sigArgs) != VECSXP ||
+        sigLength == R_UnboundValue)
+        return NULL;
+    int n = asInteger(sigLength);
+    if (n == NA_INTEGER || n < 1 || n > S4_MAX_SIGNATURE ||
+        n > XLENGTH(sigArgs))
+        return NULL;
+
+    // Implicit classes are not necessarily referenced from anywhere else
+    SEXP classes[S4_MAX_SIGNATURE];
+    for (int i = 0; i < n; ++i) {
+        SEXP sym = VECTOR_ELT(sigArgs, i);
+        classes[i] = TYPEOF(sym) == SYMSXP && sym != R_DotsSymbol
+                         ? s4ArgClass(sym, generic, env)
+                         : NULL;
+        if (!classes[i]) {
+            UNPROTECT(i);
+            return NULL;
+        }
+        PROTECT(classes[i]);
+    }
+
+    SEXP cache = cp_pool_at(ctx, *CallSite_dispatchCache(cs));
+    SEXP method = NULL;
+    for (int i = 0; i < DISPATCH_CACHE_SIZE && !method; ++i) {
+        SEXP e = VECTOR_ELT(cache, i);
+        if (e == R_NilValue || VECTOR_ELT(e, S4_ENV) != fenv)
+            continue;
+        SEXP cached = VECTOR_ELT(e, S4_CLASSES);
+        if (XLENGTH(cached) != n)
+            continue;
+        int j = 0;
+        while (j < n && STRING_ELT(cached, j) == classes[j])
+            ++j;
+        if (j == n && findVarInFrame(table, VECTOR_ELT(e, S4_LABEL)) ==
+                          VECTOR_ELT(e, S4_METHOD))
+            method = VECTOR_ELT(e, S4_METHOD);
+    }
+
+    if (!method) {
+        const void* vmax = vmaxget();
+        SEXP label = s4Label(classes, n);
+        vmaxset(vmax);
+        // Inherited methods are only in the table once standardGeneric
+        // selected them
+        method = findVarInFrame(table, label);
+        if (!s4Cachable(method)) {
+            UNPROTECT(n);
+            return NULL;
+        }
+
+        SEXP entry = PROTECT(allocVector(VECSXP, S4_ENTRY_SIZE));
+        SEXP cached = allocVector(STRSXP, n);
+        SET_VECTOR_ELT(entry, S4_CLASSES, cached);
+        for (int i = 0; i < n; ++i)
+            SET_STRING_ELT(cached, i, classes[i]);
+        SET_VECTOR_ELT(entry, S4_ENV, fenv);
+        SET_VECTOR_ELT(entry, S4_LABEL, label);
+        SET_VECTOR_ELT(entry, S4_METHOD, method);
+        for (int i = DISPATCH_CACHE_SIZE - 1; i > 0; --i)
+            SET_VECTOR_ELT(cache, i, VECTOR_ELT(cache, i - 1));
+        SET_VECTOR_ELT(cache, 0, entry);
+        UNPROTECT(1);
+    }
+
+    UNPROTECT(n);
+    profileCall(cs, method);
+    return s4Apply(method, env);
+}
 
 SEXP doDispatchStack(Code* caller, size_t nargs, uint32_t id, SEXP env,
                      OpcodeT** pc, Context* ctx) {
@@ -855,18 +1522,8 @@ SEXP doDispatchStack(Code* caller, size_t nargs, uint32_t id, SEXP env,
 
         // ===============================================
         // Then try S3
-        const char* generic = CHAR(PRINTNAME(selector));
-        char cntxt[400];
-        SEXP rho1 = Rf_NewEnvironment(R_NilValue, R_NilValue, env);
-        ostack_push(ctx, rho1);
-        initClosureContext(&cntxt, call, rho1, env, actuals, op);
-        bool success = Rf_usemethod(generic, obj, call, actuals, rho1, env,
-                                    R_BaseEnv, &res);
-        ostack_pop(ctx);
-        endClosureContext(&cntxt, success ? res : R_NilValue);
-        if (success) {
+        if (dispatchS3(cs, selector, op, obj, call, actuals, env, &res, ctx))
             break;
-        }
 
         // ===============================================
         // Now normal dispatch (mostly a copy from doCall)
@@ -976,18 +1633,8 @@ SEXP doDispatch(Code* caller, uint32_t nargs, uint32_t id, SEXP env,
 
         // ===============================================
         // Then try S3
-        const char* generic = CHAR(PRINTNAME(selector));
-        char cntxt[400];
-        SEXP rho1 = Rf_NewEnvironment(R_NilValue, R_NilValue, env);
-        ostack_push(ctx, rho1);
-        initClosureContext(&cntxt, call, rho1, env, actuals, op);
-        bool success = Rf_usemethod(generic, obj, call, actuals, rho1, env,
-                                    R_BaseEnv, &res);
-        ostack_pop(ctx);
-        endClosureContext(&cntxt, success ? res : R_NilValue);
-        if (success) {
+        if (dispatchS3(cs, selector, op, obj, call, actuals, env, &res, ctx))
             break;
-        }
 
         // ===============================================
         // Now normal dispatch (mostly a copy from doCall)
@@ -1085,6 +1732,26 @@ INSTRUCTION(call_) {
     UNPROTECT(1);
 }
 
+INSTRUCTION(call_pic_) {
+    unsigned id = readImmediate(pc);
+    unsigned nargs = readImmediate(pc);
+    SEXP cls = ostack_pop(ctx);
+    PROTECT(cls);
+    SEXP cache = cp_pool_at(ctx, *CallSite_inlineCache(CallSite_get(c, id)));
+    SEXP res = NULL;
+    for (int i = 0; i < LENGTH(cache); ++i) {
+        if (VECTOR_ELT(cache, i) == cls) {
+            res = doCachedCall(c, cls, nargs, id, env, pc, ctx);
+            break;
+        }
+    }
+    // All entries missed
+    if (!res)
+        res = doCall(c, cls, nargs, id, env, pc, ctx);
+    ostack_push(ctx, res);
+    UNPROTECT(1);
+}
+
 INSTRUCTION(dispatch_stack_) {
     unsigned id = readImmediate(pc);
     unsigned nargs = readImmediate(pc);
@@ -1097,6 +1764,16 @@ INSTRUCTION(dispatch_) {
     ostack_push(ctx, doDispatch(c, nargs, id, env, pc, ctx));
 }
 
+INSTRUCTION(std_generic_) {
+    unsigned id = readImmediate(pc);
+    readImmediate(pc);
+    CallSiteStruct* cs = CallSite_get(c, id);
+    SEXP res = dispatchS4(cs, env, ctx);
+    if (!res)
+        res = Rf_eval(cp_pool_at(ctx, cs->call), env);
+    ostack_push(ctx, res);
+}
+
 INSTRUCTION(promise_) {
     // get the Code * pointer we need
     unsigned codeOffset = readImmediate(pc);
@@ -1105,6 +1782,17 @@ INSTRUCTION(promise_) {
     ostack_push(ctx, createPromise(promiseCode, env));
 }
 
+INSTRUCTION(lazy_) {
+    SEXP stub = readConst(ctx, pc);
+    SEXP code = VECTOR_ELT(stub, 1);
+    if (code == R_NilValue) {
+        code = ctx->compiler(VECTOR_ELT(stub, 0));
+        SET_VECTOR_ELT(stub, 1, code);
+    }
+    Function* fun = (Function*)INTEGER(code);
+    ostack_push(ctx, evalRirCode(functionCode(fun), ctx, env, 0));
+}
+
 INSTRUCTION(push_code_) {
     // get the Code * pointer we need
     unsigned codeOffset = readImmediate(pc);
@@ -1207,6 +1895,7 @@ INSTRUCTION(is_) {
     case NILSXP:
     case LGLSXP:
     case REALSXP:
+    case STRSXP:
         res = TYPEOF(test) == i;
         break;
 
@@ -1277,6 +1966,27 @@ INSTRUCTION(stvar_) {
         CLEAR_FRAME_CHANGED(env);
 }
 
+/* Only unhashed frames, as those of closures, lose the binding, the cell is
+ * cleared as GNU-R's RemoveFromList does, in case someone still holds on to
+ * it. Hashed and locked frames keep it.
+ */
+INSTRUCTION(unbind_) {
+    SEXP sym = readConst(ctx, pc);
+    if (HASHTAB(env) != R_NilValue || FRAME_IS_LOCKED(env))
+        return;
+    SEXP prev = R_NilValue;
+    for (SEXP f = FRAME(env); f != R_NilValue; prev = f, f = CDR(f)) {
+        if (TAG(f) != sym)
+            continue;
+        if (prev == R_NilValue)
+            SET_FRAME(env, CDR(f));
+        else
+            SETCDR(prev, CDR(f));
+        SETCAR(f, R_UnboundValue);
+        return;
+    }
+}
+
 INSTRUCTION(aslogical_) {
     SEXP t = ostack_top(ctx);
     int r = asLogical(t);
@@ -1344,9 +2054,77 @@ INSTRUCTION(asbool_) {
     ostack_push(ctx, cond ? R_TrueValue : R_FalseValue);
 }
 
+/* The trace recorder, see trace.h. Every TRACE_INTERVAL backward branches
+ * of the body of a function which was not traced yet it starts to follow the
+ * activation which took the branch. The next backward branch of that
+ * activation closes the trace if it goes to the same loop header, and then the
+ * function is optimized on its next call. Any other backward branch, or too
+ * many conditional branches, mean the path did not stay in the loop.
+ */
+#define TRACE_INTERVAL 1024
+
+static Trace recording;
+static Code* recordingCode = NULL;
+static SEXP recordingEnv = NULL;
+static OpcodeT* recordingHeader = NULL;
+
+INLINE void traceBranch(Code* c, SEXP env, OpcodeT* at, bool taken) {
+    if (c != recordingCode || env != recordingEnv)
+        return;
+    if (recording.length == MAX_TRACE_BRANCHES) {
+        recordingCode = NULL;
+        return;
+    }
+    recording.branches[recording.length].pc = at;
+    recording.branches[recording.length].taken = taken;
+    recording.length++;
+}
+
+static void traceLoop(Code* c, SEXP env, OpcodeT* at, OpcodeT* header) {
+    if (c == recordingCode && env == recordingEnv) {
+        recordingCode = NULL;
+        if (header != recordingHeader)
+            return;
+        recording.backEdge = at;
+        Trace_record(&recording);
+        recording.fun->traced = true;
+        recording.fun->markOpt = true;
+        return;
+    }
+
+    if (c->perfCounter % TRACE_INTERVAL != 0)
+        return;
+    Function* fun = function(c);
+    if (fun->traced || fun->next || functionCode(fun) != c)
+        return;
+    recordingCode = c;
+    recordingEnv = env;
+    recordingHeader = header;
+    recording.fun = fun;
+    recording.length = 0;
+}
+
+INLINE void incPerfCount(Code* c) {
+    if (c->perfCounter < UINT_MAX) {
+        c->perfCounter++;
+        // if (c->perfCounter == 200000)
+        //     printCode(c);
+    }
+}
+
+// at is the branch instruction, header where it jumped to
+INLINE void backwardBranch(Code* c, SEXP env, OpcodeT* at, OpcodeT* header) {
+    incPerfCount(c);
+    if (c == recordingCode || c->perfCounter % TRACE_INTERVAL == 0)
+        traceLoop(c, env, at, header);
+}
+
 INSTRUCTION(brobj_) {
+    OpcodeT* at = *pc - 1;
     int offset = readJumpOffset(pc);
-    if (OBJECT(ostack_top(ctx)))
+    bool taken = OBJECT(ostack_top(ctx));
+    traceBranch(c, env, at, taken);
+    if (taken)
         *pc = *pc + offset;
     PC_BOUNDSCHECK(*pc);
 }
@@ -1359,39 +2137,38 @@ INSTRUCTION(endcontext_) {
     ostack_pop(ctx); // Context
 }
 
-INLINE void incPerfCount(Code* c) {
-    if (c->perfCounter < UINT_MAX) {
-        c->perfCounter++;
-        // if (c->perfCounter == 200000)
-        //     printCode(c);
-    }
-}
-
 INSTRUCTION(brtrue_) {
+    OpcodeT* at = *pc - 1;
     int offset = readJumpOffset(pc);
-    if (ostack_pop(ctx) == R_TrueValue) {
+    bool taken = ostack_pop(ctx) == R_TrueValue;
+    traceBranch(c, env, at, taken);
+    if (taken) {
         *pc = *pc + offset;
         if (offset < 0)
-            incPerfCount(c);
+            backwardBranch(c, env, at, *pc);
     }
     PC_BOUNDSCHECK(*pc);
 }
 
 INSTRUCTION(brfalse_) {
+    OpcodeT* at = *pc - 1;
     int offset = readJumpOffset(pc);
-    if (ostack_pop(ctx) == R_FalseValue) {
+    bool taken = ostack_pop(ctx) == R_FalseValue;
+    traceBranch(c, env, at, taken);
+    if (taken) {
         *pc = *pc + offset;
         if (offset < 0)
-            incPerfCount(c);
+            backwardBranch(c, env, at, *pc);
     }
     PC_BOUNDSCHECK(*pc);
 }
 
 INSTRUCTION(br_) {
+    OpcodeT* at = *pc - 1;
     int offset = readJumpOffset(pc);
-    if (offset < 0)
-        incPerfCount(c);
     *pc = *pc + offset;
+    if (offset < 0)
+        backwardBranch(c, env, at, *pc);
     PC_BOUNDSCHECK(*pc);
 }
 
@@ -1402,6 +2179,28 @@ SEXP do_subassign2_dflt(SEXP call, SEXP op, SEXP args, SEXP rho);
 SEXP do_subassign_dflt(SEXP call, SEXP op, SEXP args, SEXP rho);
 #endif
 
+// if the target == R_NilValue that means this is a stack allocated vector
+INLINE bool isLocalAssignTarget(SEXP target, SEXP env) {
+    return target == R_NilValue ||
+           findVarLocInFrame(env, target, NULL) != R_NilValue;
+}
+
+// After an inplace update: if the next instruction is a matching stvar
+// (which is highly probably) then we do not have to execute it, since we
+// changed the value inline. Otherwise push the updated vector.
+INLINE void finishInplaceAssign(unsigned targetI, SEXP orig, OpcodeT** pc,
+                                Context* ctx) {
+    // this is a very nice and dirty hack...
+    if (cp_pool_at(ctx, targetI) != R_NilValue && **pc == stvar_ &&
+        targetI == *(Immediate*)(*pc + 1)) {
+        *pc = *pc + sizeof(int) + 1;
+        if (NAMED(orig) == 0)
+            SET_NAMED(orig, 1);
+    } else {
+        ostack_push(ctx, orig);
+    }
+}
+
 INSTRUCTION(subassign2_) {
     SEXP val = *ostack_at(ctx, 2);
     SEXP idx = *ostack_at(ctx, 1);
@@ -1428,14 +2227,9 @@ INSTRUCTION(subassign2_) {
              (vectorT == INTSXP && (valT == INTSXP)) || (vectorT == VECSXP)) &&
             (XLENGTH(val) == 1 || vectorT == VECSXP)) { // 3
 
-            // if the target == R_NilValue that means this is a stack allocated
-            // vector
             SEXP target = cp_pool_at(ctx, targetI);
-            bool localBinding =
-                (target == R_NilValue) ||
-                (findVarLocInFrame(env, target, NULL) != R_NilValue);
 
-            if (localBinding) {
+            if (isLocalAssignTarget(target, env)) {
                 int idx_ = -1;
 
                 if (idxT == REALSXP) {
@@ -1462,18 +2256,7 @@ INSTRUCTION(subassign2_) {
                     }
                     ostack_popn(ctx, 3);
 
-                    // this is a very nice and dirty hack...
-                    // if the next instruction is a matching stvar
-                    // (which is highly probably) then we do not
-                    // have to execute it, since we changed the value inline
-                    if (target != R_NilValue && **pc == stvar_ &&
-                        *(int*)(*pc - sizeof(int)) == *(int*)(*pc + 1)) {
-                        *pc = *pc + sizeof(int) + 1;
-                        if (NAMED(orig) == 0)
-                            SET_NAMED(orig, 1);
-                    } else {
-                        ostack_push(ctx, orig);
-                    }
+                    finishInplaceAssign(targetI, orig, pc, ctx);
                     return;
                 }
             }
@@ -1520,23 +2303,440 @@ INSTRUCTION(subassign_) {
     ostack_push(ctx, res);
 }
 
-INSTRUCTION(subset2_) {
-    SEXP idx2 = *ostack_at(ctx, 0);
-    SEXP idx1 = *ostack_at(ctx, 1);
-    SEXP val = *ostack_at(ctx, 2);
+/** Checks whether val is a plain matrix, ie. the only attributes are dim
+ * (with exactly two extents) and dimnames. Stores the extents.
+ */
+INLINE bool isPlainMatrix(SEXP val, int* nrow, int* ncol) {
+    SEXP dim = R_NilValue;
+    for (SEXP a = ATTRIB(val); a != R_NilValue; a = CDR(a)) {
+        if (TAG(a) == R_DimSymbol)
+            dim = CAR(a);
+        else if (TAG(a) != R_DimNamesSymbol)
+            return false;
+    }
+    if (TYPEOF(dim) != INTSXP || SHORT_VEC_LENGTH(dim) != 2)
+        return false;
+    *nrow = INTEGER(dim)[0];
+    *ncol = INTEGER(dim)[1];
+    return true;
+}
+
+/** Converts a scalar numeric index into a 0-based offset. Returns -1 if the
+ * index is not a plain scalar in [1, extent].
+ */
+INLINE int matrixIndex(SEXP idx, int extent) {
+    if (ATTRIB(idx) != R_NilValue)
+        return -1;
+    switch (TYPEOF(idx)) {
+    case INTSXP: {
+        if (SHORT_VEC_LENGTH(idx) != 1)
+            return -1;
+        int i = *INTEGER(idx);
+        if (i != NA_INTEGER && i >= 1 && i <= extent)
+            return i - 1;
+        break;
+    }
+    case REALSXP: {
+        if (SHORT_VEC_LENGTH(idx) != 1)
+            return -1;
+        double i = *REAL(idx);
+        if (!ISNAN(i) && i >= 1 && i < (double)extent + 1)
+            return (int)i - 1;
+        break;
+    }
+    default:
+        break;
+    }
+    return -1;
+}
+
+/** Computes the cell offset of val[idx1, idx2]. Returns -1 if val is not a
+ * plain matrix or the indices are not scalar and in bounds.
+ */
+INLINE R_xlen_t matrixCell(SEXP val, SEXP idx1, SEXP idx2) {
+    int nrow, ncol;
+    if (!isPlainMatrix(val, &nrow, &ncol))
+        return -1;
+    int i = matrixIndex(idx1, nrow);
+    int j = matrixIndex(idx2, ncol);
+    if (i < 0 || j < 0)
+        return -1;
+    return i + (R_xlen_t)j * nrow;
+}
+
+/** Fast case for val[idx1, idx2] and val[[idx1, idx2]] on numerical matrices
+ * without dimnames. Both drop all attributes for a single cell, so the result
+ * is a fresh scalar. Returns NULL if the generic version has to be used.
+ */
+INLINE SEXP matrixExtract(SEXP val, SEXP idx1, SEXP idx2) {
+    SEXPTYPE vectorT = TYPEOF(val);
+    if (vectorT != REALSXP && vectorT != INTSXP && vectorT != LGLSXP)
+        return NULL;
+    // [ keeps the names of the only named dimension
+    if (getAttrib(val, R_DimNamesSymbol) != R_NilValue)
+        return NULL;
+
+    R_xlen_t cell = matrixCell(val, idx1, idx2);
+    if (cell < 0)
+        return NULL;
+
+    SEXP res = allocVector(vectorT, 1);
+    switch (vectorT) {
+    case REALSXP:
+        *REAL(res) = REAL(val)[cell];
+        break;
+    case INTSXP:
+        *INTEGER(res) = INTEGER(val)[cell];
+        break;
+    case LGLSXP:
+        *LOGICAL(res) = LOGICAL(val)[cell];
+        break;
+    }
+    return res;
+}
+
+/** Fast case for orig[idx1, idx2] <- val, updating the matrix inplace. Only
+ * applies if orig is not shared and val fits into one cell without coercing
+ * orig. Returns false if the generic version has to be used.
+ */
+INLINE bool matrixAssign(SEXP orig, SEXP idx1, SEXP idx2, SEXP val) {
+    if (MAYBE_SHARED(orig))
+        return false;
+
+    SEXPTYPE vectorT = TYPEOF(orig);
+    SEXPTYPE valT = TYPEOF(val);
+    if (!((vectorT == REALSXP && (valT == REALSXP || valT == INTSXP)) ||
+          (vectorT == INTSXP && valT == INTSXP) ||
+          (vectorT == LGLSXP && valT == LGLSXP)) ||
+        !IS_SCALAR_VALUE(val, valT))
+        return false;
+
+    R_xlen_t cell = matrixCell(orig, idx1, idx2);
+    if (cell < 0)
+        return false;
+
+    switch (vectorT) {
+    case REALSXP:
+        if (valT == REALSXP)
+            REAL(orig)[cell] = *REAL(val);
+        else
+            REAL(orig)[cell] =
+                *INTEGER(val) == NA_INTEGER ? NA_REAL : *INTEGER(val);
+        break;
+    case INTSXP:
+        INTEGER(orig)[cell] = *INTEGER(val);
+        break;
+    case LGLSXP:
+        LOGICAL(orig)[cell] = *LOGICAL(val);
+        break;
+    }
+    return true;
+}
+
+INSTRUCTION(subassign_mat_) {
+    SEXP val = *ostack_at(ctx, 3);
+    SEXP idx1 = *ostack_at(ctx, 2);
+    SEXP idx2 = *ostack_at(ctx, 1);
+    SEXP orig = *ostack_at(ctx, 0);
+
+    unsigned targetI = readImmediate(pc);
+    SEXP res;
+
+#if RIR_AS_PACKAGE == 0
+    if (isLocalAssignTarget(cp_pool_at(ctx, targetI), env) &&
+        matrixAssign(orig, idx1, idx2, val)) {
+        ostack_popn(ctx, 4);
+        finishInplaceAssign(targetI, orig, pc, ctx);
+        return;
+    }
+
+    INCREMENT_NAMED(orig);
+    SEXP args;
+    args = CONS_NR(escape(val), R_NilValue);
+    args = CONS_NR(escape(idx2), args);
+    args = CONS_NR(escape(idx1), args);
+    args = CONS_NR(escape(orig), args);
+    PROTECT(args);
+    res = do_subassign_dflt(R_NilValue, R_SubassignSym, args, env);
+    ostack_popn(ctx, 4);
+    UNPROTECT(1);
+#else
+    ostack_popn(ctx, 4);
+    res = Rf_eval(getSrcForCall(c, *pc - 1 - sizeof(Immediate), ctx), env);
+#endif
+    ostack_push(ctx, res);
+}
+
+INSTRUCTION(subassign2_mat_) {
+    SEXP val = *ostack_at(ctx, 3);
+    SEXP idx1 = *ostack_at(ctx, 2);
+    SEXP idx2 = *ostack_at(ctx, 1);
+    SEXP orig = *ostack_at(ctx, 0);
 
+    unsigned targetI = readImmediate(pc);
     SEXP res;
+
 #if RIR_AS_PACKAGE == 0
+    if (isLocalAssignTarget(cp_pool_at(ctx, targetI), env) &&
+        matrixAssign(orig, idx1, idx2, val)) {
+        ostack_popn(ctx, 4);
+        finishInplaceAssign(targetI, orig, pc, ctx);
+        return;
+    }
+
+    INCREMENT_NAMED(orig);
     SEXP args;
-    args = CONS_NR(idx2, R_NilValue);
-    args = CONS_NR(idx1, args);
-    args = CONS_NR(val, args);
-    ostack_push(ctx, args);
-    res = do_subset_dflt(R_NilValue, R_SubsetSym, args, env);
+    args = CONS_NR(escape(val), R_NilValue);
+    args = CONS_NR(escape(idx2), args);
+    args = CONS_NR(escape(idx1), args);
+    args = CONS_NR(escape(orig), args);
+    PROTECT(args);
+    res = do_subassign2_dflt(R_NilValue, R_Subassign2Sym, args, env);
     ostack_popn(ctx, 4);
+    UNPROTECT(1);
 #else
-    res = Rf_eval(getSrcForCall(c, *pc - 1, ctx), env);
+    ostack_popn(ctx, 4);
+    res = Rf_eval(getSrcForCall(c, *pc - 1 - sizeof(Immediate), ctx), env);
 #endif
+    ostack_push(ctx, res);
+}
+
+/** Looks up the position of the element named sym in the plain list val.
+ * Only exact matches are considered. The position is cached per site,
+ * together with the names vector it was computed for. Since the cache keeps
+ * that names vector alive, a pointer compare is enough to validate it.
+ * Returns -1 if there is no such element.
+ */
+INLINE int cachedNamePosition(SEXP val, SEXP sym, SEXP cache) {
+    SEXP names = R_NilValue;
+    for (SEXP a = ATTRIB(val); a != R_NilValue; a = CDR(a)) {
+        if (TAG(a) == R_NamesSymbol) {
+            names = CAR(a);
+            break;
+        }
+    }
+    if (TYPEOF(names) != STRSXP)
+        return -1;
+
+    if (VECTOR_ELT(cache, 0) == names)
+        return INTEGER(VECTOR_ELT(cache, 1))[0];
+
+    // The compiler only emits this for ascii names, so the cached CHARSXPs
+    // can be compared by identity
+    SEXP name = PRINTNAME(sym);
+    int n = XLENGTH(names);
+    for (int i = 0; i < n; ++i) {
+        if (STRING_ELT(names, i) == name) {
+            SET_VECTOR_ELT(cache, 0, names);
+            INTEGER(VECTOR_ELT(cache, 1))[0] = i;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/** Fast case for orig$name <- val and orig[["name"]] <- val, updating an
+ * unshared local list inplace if it already has an element called name.
+ * Returns false if the generic version has to be used.
+ */
+INLINE bool namedAssign(SEXP orig, SEXP sym, SEXP cache, SEXP val,
+                        SEXP target, SEXP env) {
+    // assigning NULL removes the element
+    if (TYPEOF(orig) != VECSXP || MAYBE_SHARED(orig) || val == R_NilValue ||
+        !isLocalAssignTarget(target, env))
+        return false;
+
+    int i = cachedNamePosition(orig, sym, cache);
+    if (i < 0)
+        return false;
+
+    SET_VECTOR_ELT(orig, i, escape(val));
+    return true;
+}
+
+// Specials like `$` evaluate their arguments themselves. To pass them
+// already evaluated values we wrap those in forced promises.
+INLINE SEXP forcedPromise(SEXP val) {
+    SEXP p = mkPROMISE(getterPlaceholderSym, R_NilValue);
+    SET_PRVALUE(p, escape(val));
+    return p;
+}
+
+#if RIR_AS_PACKAGE == 0
+
+static SEXP dollarFallback(SEXP call, SEXP val, SEXP sym, SEXP env) {
+    static SEXP prim = NULL;
+    if (!prim)
+        prim = findFun(R_DollarSymbol, R_BaseEnv);
+
+    SEXP args = PROTECT(forcedPromise(val));
+    args = CONS_NR(args, CONS_NR(sym, R_NilValue));
+    UNPROTECT(1);
+    PROTECT(args);
+    SEXP res = getBuiltin(prim)(call, prim, args, env);
+    UNPROTECT(1);
+    return res;
+}
+
+static SEXP dollarAssignFallback(SEXP call, SEXP orig, SEXP sym, SEXP val,
+                                 SEXP env) {
+    static SEXP prim = NULL;
+    if (!prim)
+        prim = findFun(R_DollarAssignSym, R_BaseEnv);
+
+    SEXP value = PROTECT(forcedPromise(val));
+    SEXP target = PROTECT(forcedPromise(orig));
+    SEXP args = CONS_NR(value, R_NilValue);
+    SET_TAG(args, R_valueSym);
+    args = CONS_NR(target, CONS_NR(sym, args));
+    UNPROTECT(2);
+    PROTECT(args);
+    SEXP res = getBuiltin(prim)(call, prim, args, env);
+    UNPROTECT(1);
+    return res;
+}
+#endif
+
+INSTRUCTION(dollar_) {
+    SEXP sym = readConst(ctx, pc);
+    SEXP cache = readConst(ctx, pc);
+    SEXP val = ostack_top(ctx);
+
+    SEXP res;
+    int i = TYPEOF(val) == VECSXP ? cachedNamePosition(val, sym, cache) : -1;
+    if (i >= 0) {
+        res = VECTOR_ELT(val, i);
+        if (NAMED(val) > NAMED(res))
+            SET_NAMED(res, NAMED(val));
+    } else {
+        SEXP call = getSrcForCall(c, *pc - 1 - 2 * sizeof(Immediate), ctx);
+#if RIR_AS_PACKAGE == 0
+        res = dollarFallback(call, val, sym, env);
+#else
+        res = Rf_eval(call, env);
+#endif
+    }
+
+    R_Visible = 1;
+    ostack_pop(ctx);
+    ostack_push(ctx, res);
+}
+
+INSTRUCTION(extract_name_) {
+    SEXP sym = readConst(ctx, pc);
+    SEXP cache = readConst(ctx, pc);
+    SEXP val = ostack_top(ctx);
+
+    SEXP res;
+    int i = TYPEOF(val) == VECSXP ? cachedNamePosition(val, sym, cache) : -1;
+    if (i >= 0) {
+        res = VECTOR_ELT(val, i);
+        if (NAMED(val) > NAMED(res))
+            SET_NAMED(res, NAMED(val));
+    } else {
+#if RIR_AS_PACKAGE == 0
+        SEXP args;
+        args = CONS_NR(ScalarString(PRINTNAME(sym)), R_NilValue);
+        ostack_push(ctx, args);
+        args = CONS_NR(val, args);
+        *ostack_at(ctx, 0) = args;
+        res = do_subset2_dflt(R_NilValue, R_Subset2Sym, args, env);
+        ostack_pop(ctx);
+#else
+        res = Rf_eval(
+            getSrcForCall(c, *pc - 1 - 2 * sizeof(Immediate), ctx), env);
+#endif
+    }
+
+    R_Visible = 1;
+    ostack_pop(ctx);
+    ostack_push(ctx, res);
+}
+
+INSTRUCTION(subassign_dollar_) {
+    SEXP val = *ostack_at(ctx, 1);
+    SEXP orig = *ostack_at(ctx, 0);
+
+    unsigned targetI = readImmediate(pc);
+    SEXP sym = readConst(ctx, pc);
+    SEXP cache = readConst(ctx, pc);
+    SEXP res;
+
+    if (namedAssign(orig, sym, cache, val, cp_pool_at(ctx, targetI), env)) {
+        ostack_popn(ctx, 2);
+        finishInplaceAssign(targetI, orig, pc, ctx);
+        return;
+    }
+
+    SEXP call = getSrcForCall(c, *pc - 1 - 3 * sizeof(Immediate), ctx);
+#if RIR_AS_PACKAGE == 0
+    INCREMENT_NAMED(orig);
+    res = dollarAssignFallback(call, orig, sym, val, env);
+    ostack_popn(ctx, 2);
+#else
+    ostack_popn(ctx, 2);
+    res = Rf_eval(call, env);
+#endif
+    ostack_push(ctx, res);
+}
+
+INSTRUCTION(subassign2_name_) {
+    SEXP val = *ostack_at(ctx, 1);
+    SEXP orig = *ostack_at(ctx, 0);
+
+    unsigned targetI = readImmediate(pc);
+    SEXP sym = readConst(ctx, pc);
+    SEXP cache = readConst(ctx, pc);
+    SEXP res;
+
+    if (namedAssign(orig, sym, cache, val, cp_pool_at(ctx, targetI), env)) {
+        ostack_popn(ctx, 2);
+        finishInplaceAssign(targetI, orig, pc, ctx);
+        return;
+    }
+
+#if RIR_AS_PACKAGE == 0
+    INCREMENT_NAMED(orig);
+    SEXP args;
+    args = CONS_NR(escape(val), R_NilValue);
+    PROTECT(args);
+    args = CONS_NR(ScalarString(PRINTNAME(sym)), args);
+    UNPROTECT(1);
+    args = CONS_NR(escape(orig), args);
+    PROTECT(args);
+    res = do_subassign2_dflt(R_NilValue, R_Subassign2Sym, args, env);
+    ostack_popn(ctx, 2);
+    UNPROTECT(1);
+#else
+    ostack_popn(ctx, 2);
+    res = Rf_eval(getSrcForCall(c, *pc - 1 - 3 * sizeof(Immediate), ctx),
+                  env);
+#endif
+    ostack_push(ctx, res);
+}
+
+INSTRUCTION(subset2_) {
+    SEXP idx2 = *ostack_at(ctx, 0);
+    SEXP idx1 = *ostack_at(ctx, 1);
+    SEXP val = *ostack_at(ctx, 2);
+
+    SEXP res = matrixExtract(val, idx1, idx2);
+    if (res) {
+        ostack_popn(ctx, 3);
+    } else {
+#if RIR_AS_PACKAGE == 0
+        SEXP args;
+        args = CONS_NR(idx2, R_NilValue);
+        args = CONS_NR(idx1, args);
+        args = CONS_NR(val, args);
+        ostack_push(ctx, args);
+        res = do_subset_dflt(R_NilValue, R_SubsetSym, args, env);
+        ostack_popn(ctx, 4);
+#else
+        res = Rf_eval(getSrcForCall(c, *pc - 1, ctx), env);
+        ostack_popn(ctx, 3);
+#endif
+    }
 
     R_Visible = 1;
     ostack_push(ctx, res);
@@ -1547,38 +2747,187 @@ INSTRUCTION(extract2_) {
     SEXP idx1 = *ostack_at(ctx, 1);
     SEXP val = *ostack_at(ctx, 2);
 
-    SEXP res;
+    SEXP res = matrixExtract(val, idx1, idx2);
+    if (res) {
+        ostack_popn(ctx, 3);
+    } else {
 #if RIR_AS_PACKAGE == 0
-    SEXP args;
-    args = CONS_NR(idx2, R_NilValue);
-    args = CONS_NR(idx1, args);
-    args = CONS_NR(val, args);
-    ostack_push(ctx, args);
-    res = do_subset_dflt(R_NilValue, R_Subset2Sym, args, env);
-    ostack_popn(ctx, 4);
+        SEXP args;
+        args = CONS_NR(idx2, R_NilValue);
+        args = CONS_NR(idx1, args);
+        args = CONS_NR(val, args);
+        ostack_push(ctx, args);
+        res = do_subset2_dflt(R_NilValue, R_Subset2Sym, args, env);
+        ostack_popn(ctx, 4);
 #else
-    res = Rf_eval(getSrcForCall(c, *pc - 1, ctx), env);
+        res = Rf_eval(getSrcForCall(c, *pc - 1, ctx), env);
+        ostack_popn(ctx, 3);
 #endif
+    }
 
     R_Visible = 1;
     ostack_push(ctx, res);
 }
 
+/** Copies the elements of val whose keep flag is set into res, which must
+ * have exactly as many elements as there are set flags. The loop always
+ * stores and only advances the output when the flag is set, so there is no
+ * data dependent branch in the body.
+ */
+INLINE void compactByMask(SEXP res, SEXP val, const int* keep) {
+    R_xlen_t n = XLENGTH(res);
+#define COMPACT(T, ACCESSOR)                                                   \
+    {                                                                          \
+        T* out = ACCESSOR(res);                                                \
+        const T* in = ACCESSOR(val);                                           \
+        R_xlen_t k = 0;                                                        \
+        for (R_xlen_t i = 0; k < n; ++i) {                                     \
+            out[k] = in[i];                                                    \
+            k += keep[i] != 0;                                                 \
+        }                                                                      \
+    }
+    switch (TYPEOF(val)) {
+    case REALSXP:
+        COMPACT(double, REAL);
+        break;
+    case INTSXP:
+        COMPACT(int, INTEGER);
+        break;
+    case LGLSXP:
+        COMPACT(int, LOGICAL);
+        break;
+    }
+#undef COMPACT
+}
+
+/** val[mask] for a logical mask of the same length without NAs. */
+INLINE SEXP maskSubset(SEXP val, SEXP idx) {
+    R_xlen_t len = XLENGTH(val);
+    if (XLENGTH(idx) != len)
+        return NULL;
+
+    const int* mask = LOGICAL(idx);
+    R_xlen_t n = 0;
+    bool hasNA = false;
+    for (R_xlen_t i = 0; i < len; ++i) {
+        n += mask[i] != 0;
+        hasNA |= mask[i] == NA_LOGICAL;
+    }
+    if (hasNA)
+        return NULL;
+
+    SEXP res = allocVector(TYPEOF(val), n);
+    compactByMask(res, val, mask);
+    return res;
+}
+
+/** val[idx] for a numeric idx whose elements are either all positive or all
+ * negative positions within bounds. Zero, NA and mixed signs are left to the
+ * generic version.
+ */
+INLINE SEXP positionSubset(SEXP val, SEXP idx) {
+    R_xlen_t len = XLENGTH(val);
+    R_xlen_t nidx = XLENGTH(idx);
+    if (nidx == 0)
+        return NULL;
+
+    // Convert to 0-based offsets, negative positions are encoded as ~offset
+    bool isInt = TYPEOF(idx) == INTSXP;
+    bool negative = isInt ? INTEGER(idx)[0] < 0 : REAL(idx)[0] < 0;
+    for (R_xlen_t i = 0; i < nidx; ++i) {
+        double p = isInt ? (INTEGER(idx)[i] == NA_INTEGER ? NA_REAL
+                                                           : INTEGER(idx)[i])
+                         : REAL(idx)[i];
+        if (ISNAN(p))
+            return NULL;
+        if (negative ? !(p <= -1 && p > -(double)len - 1)
+                     : !(p >= 1 && p < (double)len + 1))
+            return NULL;
+    }
+
+#define POSITION(i)                                                            \
+    (isInt ? (R_xlen_t)INTEGER(idx)[i] : (R_xlen_t)REAL(idx)[i])
+
+    SEXP res;
+    if (!negative) {
+        SEXPTYPE vectorT = TYPEOF(val);
+        res = allocVector(vectorT, nidx);
+        for (R_xlen_t i = 0; i < nidx; ++i) {
+            R_xlen_t j = POSITION(i) - 1;
+            switch (vectorT) {
+            case REALSXP:
+                REAL(res)[i] = REAL(val)[j];
+                break;
+            case INTSXP:
+                INTEGER(res)[i] = INTEGER(val)[j];
+                break;
+            case LGLSXP:
+                LOGICAL(res)[i] = LOGICAL(val)[j];
+                break;
+            }
+        }
+    } else {
+        // Exclusion: mark the dropped elements, then compact the rest
+        const void* vmax = vmaxget();
+        int* keep = (int*)R_alloc(len, sizeof(int));
+        for (R_xlen_t i = 0; i < len; ++i)
+            keep[i] = 1;
+        R_xlen_t n = len;
+        for (R_xlen_t i = 0; i < nidx; ++i) {
+            R_xlen_t j = -POSITION(i) - 1;
+            n -= keep[j];
+            keep[j] = 0;
+        }
+        res = allocVector(TYPEOF(val), n);
+        compactByMask(res, val, keep);
+        vmaxset(vmax);
+    }
+#undef POSITION
+    return res;
+}
+
+/** Fast case for val[idx] on attribute-free numerical vectors with a logical
+ * mask or a vector of positions as index. The index is checked and counted in
+ * one pass and the result is allocated once. Returns NULL if the generic
+ * version has to be used.
+ */
+INLINE SEXP vectorSubset(SEXP val, SEXP idx) {
+    SEXPTYPE vectorT = TYPEOF(val);
+    if ((vectorT != REALSXP && vectorT != INTSXP && vectorT != LGLSXP) ||
+        ATTRIB(val) != R_NilValue || ATTRIB(idx) != R_NilValue)
+        return NULL;
+
+    switch (TYPEOF(idx)) {
+    case LGLSXP:
+        return maskSubset(val, idx);
+    case INTSXP:
+    case REALSXP:
+        return positionSubset(val, idx);
+    default:
+        return NULL;
+    }
+}
+
 INSTRUCTION(subset1_) {
     SEXP idx = *ostack_at(ctx, 0);
     SEXP val = *ostack_at(ctx, 1);
 
-    SEXP res;
+    SEXP res = vectorSubset(val, idx);
+    if (res) {
+        ostack_popn(ctx, 2);
+    } else {
 #if RIR_AS_PACKAGE == 0
-    SEXP args;
-    args = CONS_NR(idx, R_NilValue);
-    args = CONS_NR(val, args);
-    ostack_push(ctx, args);
-    res = do_subset_dflt(R_NilValue, R_SubsetSym, args, env);
-    ostack_popn(ctx, 3);
+        SEXP args;
+        args = CONS_NR(idx, R_NilValue);
+        args = CONS_NR(val, args);
+        ostack_push(ctx, args);
+        res = do_subset_dflt(R_NilValue, R_SubsetSym, args, env);
+        ostack_popn(ctx, 3);
 #else
-    res = Rf_eval(getSrcForCall(c, *pc - 1, ctx), env);
+        res = Rf_eval(getSrcForCall(c, *pc - 1, ctx), env);
+        ostack_popn(ctx, 2);
 #endif
+    }
 
     R_Visible = 1;
     ostack_push(ctx, res);
@@ -1643,6 +2992,10 @@ INSTRUCTION(extract1_) {
         goto fallback;
     }
 
+    if (TYPEOF(val) == REALSXP && ATTRIB(val) == R_NilValue &&
+        TYPEOF(idx) != LGLSXP)
+        QUICKEN(*pc, extract1_real_);
+
     R_Visible = 1;
     ostack_popn(ctx, 2);
     ostack_push(ctx, res);
@@ -1667,28 +3020,69 @@ INSTRUCTION(extract1_) {
     ostack_push(ctx, res);
 }
 
+/** extract1_ for a real vector without attributes and a numeric index */
+INSTRUCTION(extract1_real_) {
+    SEXP idx = *ostack_at(ctx, 0);
+    SEXP val = *ostack_at(ctx, 1);
+
+    double d = -1;
+    if (TYPEOF(idx) == REALSXP && SHORT_VEC_LENGTH(idx) == 1)
+        d = *REAL(idx);
+    else if (TYPEOF(idx) == INTSXP && SHORT_VEC_LENGTH(idx) == 1 &&
+             *INTEGER(idx) != NA_INTEGER)
+        d = *INTEGER(idx);
+
+    if (TYPEOF(val) != REALSXP || ATTRIB(val) != R_NilValue ||
+        ATTRIB(idx) != R_NilValue || !(d >= 1 && d < XLENGTH(val) + 1)) {
+        QUICKEN(*pc, extract1_);
+        ins_extract1_(c, env, pc, ctx, numArgs, cStore);
+        return;
+    }
+
+    R_xlen_t i = (R_xlen_t)d - 1;
+    SEXP res;
+    if (SHORT_VEC_LENGTH(val) == 1 && !MAYBE_SHARED(val))
+        res = val;
+    else
+        res = allocVector(REALSXP, 1);
+    REAL(res)[0] = REAL(val)[i];
+
+    R_Visible = 1;
+    ostack_popn(ctx, 2);
+    ostack_push(ctx, res);
+}
+
 INSTRUCTION(dup_) { ostack_push(ctx, ostack_top(ctx)); }
 
+// Continues in the unoptimized version of the function, at the pc registered
+// for deoptId
+INLINE void deoptimize(Code* c, uint32_t deoptId, OpcodeT** pc,
+                       Code** cStore) {
+    Function* fun = function(c);
+    assert(functionCode(fun) == c && "Cannot deopt from promise");
+    fun->deopt = true;
+    SEXP deopt = fun->origin;
+    Function* deoptFun = (Function*)INTEGER(deopt);
+    Code* deoptCode = functionCode(deoptFun);
+    *cStore = deoptCode;
+    *pc = Deoptimizer_pc(deoptId);
+}
+
 INSTRUCTION(guard_env_) {
     uint32_t deoptId = readImmediate(pc);
-    if (FRAME_CHANGED(env) || FRAME_LEAKED(env)) {
-        Function* fun = function(c);
-        assert(functionCode(fun) == c && "Cannot deopt from promise");
-        fun->deopt = true;
-        SEXP deopt = fun->origin;
-        Function* deoptFun = (Function*)INTEGER(deopt);
-        Code* deoptCode = functionCode(deoptFun);
-        *cStore = deoptCode;
-        *pc = Deoptimizer_pc(deoptId);
-    }
+    if (FRAME_CHANGED(env) || FRAME_LEAKED(env))
+        deoptimize(c, deoptId, pc, cStore);
 }
 
 INSTRUCTION(guard_fun_) {
     SEXP sym = readConst(ctx, pc);
     SEXP expected = readConst(ctx, pc);
-    readImmediate(pc);
+    uint32_t deoptId = readImmediate(pc);
     SEXP val = findFun(sym, env);
-    assert(val == expected);
+    if (val != expected) {
+        assert(deoptId != NO_DEOPT_INFO);
+        deoptimize(c, deoptId, pc, cStore);
+    }
 }
 
 INSTRUCTION(isfun_) {
@@ -1781,6 +3175,231 @@ enum op { PLUSOP, MINUSOP, TIMESOP, DIVOP, POWOP, MODOP, IDIVOP };
         }                                                                      \
     } while (0)
 
+/** Reads a scalar logical, integer or real into a double, with NA mapped to
+ * NA_REAL. Integers are exactly representable, so comparing the doubles gives
+ * the same answer as comparing the original values.
+ */
+INLINE bool scalarNumber(SEXP x, double* res) {
+    if (ATTRIB(x) != R_NilValue || SHORT_VEC_LENGTH(x) != 1)
+        return false;
+    switch (TYPEOF(x)) {
+    case REALSXP:
+        *res = *REAL(x);
+        return true;
+    case INTSXP:
+    case LGLSXP: {
+        int i = TYPEOF(x) == INTSXP ? *INTEGER(x) : *LOGICAL(x);
+        *res = i == NA_INTEGER ? NA_REAL : (double)i;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+/** Reads a scalar complex, real, integer or logical into a complex, the same
+ * way arithmetic coerces its operands. Returns false for anything else.
+ */
+INLINE bool scalarComplex(SEXP x, Rcomplex* res) {
+    if (ATTRIB(x) != R_NilValue || SHORT_VEC_LENGTH(x) != 1)
+        return false;
+    switch (TYPEOF(x)) {
+    case CPLXSXP:
+        *res = *COMPLEX(x);
+        return true;
+    case REALSXP:
+        res->r = *REAL(x);
+        res->i = 0;
+        return true;
+    case INTSXP:
+    case LGLSXP: {
+        int i = TYPEOF(x) == INTSXP ? *INTEGER(x) : *LOGICAL(x);
+        if (i == NA_INTEGER) {
+            res->r = NA_REAL;
+            res->i = NA_REAL;
+        } else {
+            res->r = i;
+            res->i = 0;
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// As R's toC99, with a.r + a.i * I an infinite or NaN part would make both
+// parts NaN
+INLINE double complex toC99(const Rcomplex* x) {
+    double complex z;
+    __real__ z = x->r;
+    __imag__ z = x->i;
+    return z;
+}
+
+/** Fast case for scalar arithmetic where at least one operand is complex.
+ * Follows GNU-R: multiplication uses C99 complex arithmetic and division
+ * Smith's algorithm. Returns NULL if the generic version has to be used.
+ */
+static SEXP complexArith(enum op op, SEXP lhs, SEXP rhs) {
+    if (TYPEOF(lhs) != CPLXSXP && TYPEOF(rhs) != CPLXSXP)
+        return NULL;
+
+    Rcomplex a, b, r;
+    if (!scalarComplex(lhs, &a) || !scalarComplex(rhs, &b))
+        return NULL;
+
+    switch (op) {
+    case PLUSOP:
+        r.r = a.r + b.r;
+        r.i = a.i + b.i;
+        break;
+    case MINUSOP:
+        r.r = a.r - b.r;
+        r.i = a.i - b.i;
+        break;
+    case TIMESOP: {
+        double complex z = toC99(&a) * toC99(&b);
+        r.r = creal(z);
+        r.i = cimag(z);
+        break;
+    }
+    case DIVOP: {
+        double ratio, den;
+        if (fabs(b.r) <= fabs(b.i)) {
+            ratio = b.r / b.i;
+            den = b.i * (1 + ratio * ratio);
+            r.r = (a.r * ratio + a.i) / den;
+            r.i = (a.i * ratio - a.r) / den;
+        } else {
+            ratio = b.i / b.r;
+            den = b.r * (1 + ratio * ratio);
+            r.r = (a.r + a.i * ratio) / den;
+            r.i = (a.i - a.r * ratio) / den;
+        }
+        break;
+    }
+    default:
+        return NULL;
+    }
+
+    SEXP res = allocVector(CPLXSXP, 1);
+    *COMPLEX(res) = r;
+    return res;
+}
+
+/** Checks whether lhs and rhs can be handed to a vector kernel, ie. they have
+ * no attributes and either the same length or one of them is a scalar (the
+ * other cases might warn). Returns the length of the result or -1.
+ */
+INLINE R_xlen_t kernelLength(SEXP lhs, SEXP rhs) {
+    if (ATTRIB(lhs) != R_NilValue || ATTRIB(rhs) != R_NilValue)
+        return -1;
+    R_xlen_t nx = XLENGTH(lhs);
+    R_xlen_t ny = XLENGTH(rhs);
+    if (nx == ny)
+        return nx;
+    if (nx == 1 && ny > 0)
+        return ny;
+    if (ny == 1 && nx > 0)
+        return nx;
+    return -1;
+}
+
+/** The doubles of x for a vector kernel. A non NA integer scalar is widened
+ * into buf, anything else needs the generic version and yields NULL.
+ */
+INLINE const double* kernelReals(SEXP x, double* buf) {
+    if (TYPEOF(x) == REALSXP)
+        return REAL(x);
+    if (TYPEOF(x) == INTSXP && XLENGTH(x) == 1 &&
+        *INTEGER(x) != NA_INTEGER) {
+        *buf = *INTEGER(x);
+        return buf;
+    }
+    return NULL;
+}
+
+/** Fast case for +, -, * and / on attribute-free double and integer vectors.
+ * Sets overflow if an integer result was out of range. Returns NULL if the
+ * generic version has to be used.
+ */
+static SEXP vectorArith(enum op op, SEXP lhs, SEXP rhs, bool* overflow) {
+    R_xlen_t n = kernelLength(lhs, rhs);
+    if (n < 0)
+        return NULL;
+
+    ArithKernel kernel;
+    switch (op) {
+    case PLUSOP:
+        kernel = KERNEL_ADD;
+        break;
+    case MINUSOP:
+        kernel = KERNEL_SUB;
+        break;
+    case TIMESOP:
+        kernel = KERNEL_MUL;
+        break;
+    case DIVOP:
+        kernel = KERNEL_DIV;
+        break;
+    default:
+        return NULL;
+    }
+
+    R_xlen_t nx = XLENGTH(lhs);
+    R_xlen_t ny = XLENGTH(rhs);
+    SEXP res;
+    if (TYPEOF(lhs) == INTSXP && TYPEOF(rhs) == INTSXP) {
+        if (kernel == KERNEL_DIV) {
+            res = allocVector(REALSXP, n);
+            intDivKernel(REAL(res), n, INTEGER(lhs), nx, INTEGER(rhs), ny);
+        } else {
+            res = allocVector(INTSXP, n);
+            *overflow = intArithKernel(kernel, INTEGER(res), n, INTEGER(lhs),
+                                       nx, INTEGER(rhs), ny);
+        }
+        return res;
+    }
+
+    double lbuf, rbuf;
+    const double* x = kernelReals(lhs, &lbuf);
+    const double* y = kernelReals(rhs, &rbuf);
+    if (!x || !y)
+        return NULL;
+    res = allocVector(REALSXP, n);
+    realArithKernel(kernel, REAL(res), n, x, nx, y, ny);
+    return res;
+}
+
+/** Fast case for the relational operators on attribute-free double and
+ * integer vectors. Returns NULL if the generic version has to be used.
+ */
+static SEXP vectorCompare(CompareKernel kernel, SEXP lhs, SEXP rhs) {
+    R_xlen_t n = kernelLength(lhs, rhs);
+    if (n < 0)
+        return NULL;
+
+    R_xlen_t nx = XLENGTH(lhs);
+    R_xlen_t ny = XLENGTH(rhs);
+    SEXP res;
+    if (TYPEOF(lhs) == INTSXP && TYPEOF(rhs) == INTSXP) {
+        res = allocVector(LGLSXP, n);
+        intCompareKernel(kernel, LOGICAL(res), n, INTEGER(lhs), nx,
+                         INTEGER(rhs), ny);
+        return res;
+    }
+
+    double lbuf, rbuf;
+    const double* x = kernelReals(lhs, &lbuf);
+    const double* y = kernelReals(rhs, &rbuf);
+    if (!x || !y)
+        return NULL;
+    res = allocVector(LGLSXP, n);
+    realCompareKernel(kernel, LOGICAL(res), n, x, nx, y, ny);
+    return res;
+}
+
 #define BINOP_FALLBACK(op)                                                     \
     do {                                                                       \
         static SEXP prim = NULL;                                               \
@@ -1802,8 +3421,26 @@ enum op { PLUSOP, MINUSOP, TIMESOP, DIVOP, POWOP, MODOP, IDIVOP };
         ostack_pop(ctx);                                                       \
     } while (false)
 
-#define IS_SCALAR_VALUE(e, type)                                               \
-    (TYPEOF(e) == type && SHORT_VEC_LENGTH(e) == 1 && ATTRIB(e) == R_NilValue)
+#define UNOP_FALLBACK(op)                                                      \
+    do {                                                                       \
+        static SEXP prim = NULL;                                               \
+        static CCODE blt;                                                      \
+        static int flag;                                                       \
+        if (!prim) {                                                           \
+            prim = findFun(Rf_install(op), R_GlobalEnv);                       \
+            blt = getBuiltin(prim);                                            \
+            flag = getFlag(prim);                                              \
+        }                                                                      \
+        SEXP call = getSrcForCall(c, *pc - 1, ctx);                            \
+        SEXP argslist = CONS_NR(val, R_NilValue);                              \
+        ostack_push(ctx, argslist);                                            \
+        if (flag < 2)                                                          \
+            R_Visible = flag != 1;                                             \
+        res = blt(call, prim, argslist, env);                                  \
+        if (flag < 2)                                                          \
+            R_Visible = flag != 1;                                             \
+        ostack_pop(ctx);                                                       \
+    } while (false)
 
 #define DO_BINOP(op, op2)                                                      \
     do {                                                                       \
@@ -1851,6 +3488,13 @@ enum op { PLUSOP, MINUSOP, TIMESOP, DIVOP, POWOP, MODOP, IDIVOP };
                 break;                                                         \
             }                                                                  \
         }                                                                      \
+        bool overflow = false;                                                 \
+        if ((res = vectorArith(op2, lhs, rhs, &overflow))) {                   \
+            CHECK_INTEGER_OVERFLOW(res, overflow);                             \
+            break;                                                             \
+        }                                                                      \
+        if ((res = complexArith(op2, lhs, rhs)))                               \
+            break;                                                             \
         BINOP_FALLBACK(#op);                                                   \
     } while (false)
 
@@ -1861,33 +3505,408 @@ INSTRUCTION(mul_) {
 
     DO_BINOP(*, TIMESOP);
 
-    ostack_popn(ctx, 2);
-    ostack_push(ctx, res);
+    ostack_popn(ctx, 2);
+    ostack_push(ctx, res);
+}
+
+INSTRUCTION(div_) {
+    SEXP lhs = *ostack_at(ctx, 1);
+    SEXP rhs = *ostack_at(ctx, 0);
+    SEXP res;
+
+    if (IS_SCALAR_VALUE(lhs, REALSXP) && IS_SCALAR_VALUE(rhs, REALSXP)) {
+        res = Rf_allocVector(REALSXP, 1);
+        *REAL(res) = (*REAL(lhs) == NA_REAL || *REAL(rhs) == NA_REAL)
+                         ? NA_REAL
+                         : *REAL(lhs) / *REAL(rhs);
+    } else if (IS_SCALAR_VALUE(lhs, INTSXP) && IS_SCALAR_VALUE(rhs, INTSXP)) {
+        res = Rf_allocVector(REALSXP, 1);
+        int l = *INTEGER(lhs);
+        int r = *INTEGER(rhs);
+        if (l == NA_INTEGER || r == NA_INTEGER)
+            *REAL(res) = NA_REAL;
+        else
+            *REAL(res) = (double)l / (double)r;
+    } else {
+        bool overflow = false;
+        if (!(res = vectorArith(DIVOP, lhs, rhs, &overflow)) &&
+            !(res = complexArith(DIVOP, lhs, rhs)))
+            BINOP_FALLBACK("/");
+    }
+
+    ostack_popn(ctx, 2);
+    ostack_push(ctx, res);
+}
+
+static const char* const reductionName[] = {
+#define V(name) #name,
+    REDUCTIONS(V)
+#undef V
+};
+
+// GNU-R clamps sums and products which overflow the double range
+INLINE double clampLongDouble(long double s) {
+    if (s > DBL_MAX)
+        return R_PosInf;
+    if (s < -DBL_MAX)
+        return R_NegInf;
+    return (double)s;
+}
+
+/** State of a reduction over doubles which are passed block by block. */
+typedef struct {
+    Reduction kind;
+    long double acc;
+    long double mean;
+    double extreme;
+    bool nan;
+    bool na;
+} RealReduction;
+
+static void realReductionInit(RealReduction* r, Reduction kind) {
+    r->kind = kind;
+    r->acc = kind == REDUCE_prod ? 1 : 0;
+    r->extreme = kind == REDUCE_min ? R_PosInf : R_NegInf;
+    r->nan = r->na = false;
+}
+
+static void realReductionBlock(void* data, const double* x, R_xlen_t n) {
+    RealReduction* r = (RealReduction*)data;
+    bool nan = false;
+    switch (r->kind) {
+    case REDUCE_sum:
+        realSumKernel(&r->acc, x, n);
+        break;
+    case REDUCE_prod:
+        realProdKernel(&r->acc, x, n);
+        break;
+    case REDUCE_min:
+        nan = realMinKernel(&r->extreme, x, n);
+        break;
+    case REDUCE_max:
+        nan = realMaxKernel(&r->extreme, x, n);
+        break;
+    default:
+        assert(false);
+    }
+    if (nan) {
+        r->nan = true;
+        r->na = r->na || realHasNAKernel(x, n);
+    }
+}
+
+static double realReductionResult(RealReduction* r) {
+    switch (r->kind) {
+    case REDUCE_sum:
+    case REDUCE_prod:
+        return clampLongDouble(r->acc);
+    case REDUCE_min:
+    case REDUCE_max:
+        return r->nan ? (r->na ? NA_REAL : R_NaN) : r->extreme;
+    default:
+        assert(false);
+        return 0;
+    }
+}
+
+// The second pass of mean()
+static void realDeviationBlock(void* data, const double* x, R_xlen_t n) {
+    RealReduction* r = (RealReduction*)data;
+    realDeviationKernel(&r->acc, r->mean, x, n);
+}
+
+/** Fast case for the reductions of a single non-object vector, following
+ * do_summary and do_logic3 of GNU-R. Sets overflow if an integer sum was out
+ * of range. Returns NULL if the generic version has to be used, eg. for empty
+ * vectors where min and max warn.
+ */
+static SEXP reduceVector(Reduction kind, SEXP x, bool* overflow) {
+    if (isObject(x))
+        return NULL;
+    R_xlen_t n;
+    SEXPTYPE type = TYPEOF(x);
+    switch (type) {
+    case LGLSXP:
+        if (kind == REDUCE_any || kind == REDUCE_all) {
+            R_xlen_t nTrue, nNA;
+            lglCountKernel(&nTrue, &nNA, LOGICAL(x), XLENGTH(x));
+            int res;
+            if (kind == REDUCE_any)
+                res = nTrue ? TRUE : (nNA ? NA_LOGICAL : FALSE);
+            else if (nTrue + nNA < XLENGTH(x))
+                res = FALSE;
+            else
+                res = nNA ? NA_LOGICAL : TRUE;
+            return ScalarLogical(res);
+        }
+    // fall through, logicals are summed up as integers
+    case INTSXP: {
+        const int* v = type == INTSXP ? INTEGER(x) : LOGICAL(x);
+        n = XLENGTH(x);
+        switch (kind) {
+        case REDUCE_sum: {
+            long long s = 0;
+            if (intSumKernel(&s, v, n))
+                return ScalarInteger(NA_INTEGER);
+            if (s > INT_MAX || s < -INT_MAX) {
+                *overflow = true;
+                return ScalarInteger(NA_INTEGER);
+            }
+            return ScalarInteger((int)s);
+        }
+        case REDUCE_prod: {
+            long double s = 1;
+            if (intProdKernel(&s, v, n))
+                return ScalarReal(NA_REAL);
+            return ScalarReal(clampLongDouble(s));
+        }
+        case REDUCE_min:
+        case REDUCE_max: {
+            if (n == 0)
+                return NULL;
+            int m = v[0];
+            bool na = kind == REDUCE_min ? intMinKernel(&m, v, n)
+                                         : intMaxKernel(&m, v, n);
+            return ScalarInteger(na ? NA_INTEGER : m);
+        }
+        case REDUCE_mean: {
+            long long s = 0;
+            if (intSumKernel(&s, v, n))
+                return ScalarReal(NA_REAL);
+            return ScalarReal((double)((long double)s / n));
+        }
+        default:
+            return NULL;
+        }
+    }
+    case REALSXP: {
+        const double* v = REAL(x);
+        n = XLENGTH(x);
+        if (kind == REDUCE_any || kind == REDUCE_all)
+            return NULL;
+        if (kind == REDUCE_mean) {
+            long double s = 0;
+            realSumKernel(&s, v, n);
+            s /= n;
+            if (R_FINITE((double)s)) {
+                long double t = 0;
+                realDeviationKernel(&t, s, v, n);
+                s += t / n;
+            }
+            return ScalarReal((double)s);
+        }
+        if ((kind == REDUCE_min || kind == REDUCE_max) && n == 0)
+            return NULL;
+        RealReduction r;
+        realReductionInit(&r, kind);
+        realReductionBlock(&r, v, n);
+        return ScalarReal(realReductionResult(&r));
+    }
+    default:
+        return NULL;
+    }
+}
+
+#define SUM_OVERFLOW_WARNING "integer overflow - use sum(as.numeric(.))"
+
+static SEXP reduceFallback(SEXP call, Reduction kind, SEXP val, SEXP env) {
+    static SEXP fun[numReductions_];
+    if (!fun[kind])
+        fun[kind] = findFun(Rf_install(reductionName[kind]), R_BaseEnv);
+
+    SEXP res;
+    if (TYPEOF(fun[kind]) == CLOSXP) {
+        // mean is a closure, call it with the argument as an already forced
+        // promise of its expression, for substitute and sys.call
+        SEXP arg = PROTECT(mkPROMISE(CADR(call), env));
+        SET_PRVALUE(arg, val);
+        SEXP args = PROTECT(CONS_NR(arg, R_NilValue));
+        res = applyClosure(call, fun[kind], args, env, R_NilValue);
+        UNPROTECT(2);
+    } else {
+        SEXP args = PROTECT(CONS_NR(val, R_NilValue));
+        res = getBuiltin(fun[kind])(call, fun[kind], args, env);
+        UNPROTECT(1);
+    }
+    return res;
+}
+
+/** The reduction, warnings included. */
+static SEXP reduce(SEXP call, Reduction kind, SEXP val, SEXP env) {
+    bool overflow = false;
+    SEXP res = reduceVector(kind, val, &overflow);
+    if (!res)
+        return reduceFallback(call, kind, val, env);
+    if (overflow) {
+        PROTECT(res);
+        Rf_warningcall(call, SUM_OVERFLOW_WARNING);
+        UNPROTECT(1);
+    }
+    return res;
+}
+
+// A fused expression followed by sum, prod, min, max or mean
+static SEXP fusedReduce(Reduction kind, const int* program, int length,
+                        const FusedLeaf* leaves, R_xlen_t n) {
+    RealReduction r;
+    if (kind == REDUCE_mean) {
+        realReductionInit(&r, REDUCE_sum);
+        fusedReduceKernel(program, length, leaves, n, realReductionBlock, &r);
+        long double s = r.acc / n;
+        if (R_FINITE((double)s)) {
+            r.mean = s;
+            r.acc = 0;
+            fusedReduceKernel(program, length, leaves, n, realDeviationBlock,
+                              &r);
+            s += r.acc / n;
+        }
+        return ScalarReal((double)s);
+    }
+    realReductionInit(&r, kind);
+    fusedReduceKernel(program, length, leaves, n, realReductionBlock, &r);
+    return ScalarReal(realReductionResult(&r));
+}
+
+/** Fast case for a fused expression (see optimizer/fusion.h): the leaves are
+ * attribute-free doubles of one common length, or scalars. Non NA integer
+ * scalars are fine too, as long as no operation besides / has two integer
+ * operands, since that would yield an integer. Returns NULL if the operations
+ * have to be done one by one.
+ */
+static SEXP fusedArith(SEXP program, SEXP* leaves, unsigned nleaves) {
+    FusedLeaf leaf[MAX_FUSED_LEAVES];
+    bool isInt[MAX_FUSED_LEAVES];
+    R_xlen_t n = 1;
+    for (unsigned i = 0; i < nleaves; ++i) {
+        SEXP x = leaves[i];
+        if (ATTRIB(x) != R_NilValue)
+            return NULL;
+        if (TYPEOF(x) == REALSXP) {
+            R_xlen_t length = XLENGTH(x);
+            if (length == 0)
+                return NULL;
+            if (length == 1) {
+                leaf[i].data = NULL;
+                leaf[i].value = *REAL(x);
+            } else {
+                if (n != 1 && n != length)
+                    return NULL;
+                n = length;
+                leaf[i].data = REAL(x);
+            }
+            isInt[i] = false;
+        } else if (IS_SCALAR_VALUE(x, INTSXP) && *INTEGER(x) != NA_INTEGER) {
+            leaf[i].data = NULL;
+            leaf[i].value = *INTEGER(x);
+            isInt[i] = true;
+        } else {
+            return NULL;
+        }
+    }
+
+    SEXP code = VECTOR_ELT(program, 0);
+    const int* p = INTEGER(code);
+    int length = LENGTH(code);
+    bool stack[MAX_FUSED_LEAVES];
+    int sp = 0;
+    for (int i = 0; i < length; ++i) {
+        if (p[i] >= 0) {
+            stack[sp++] = isInt[p[i]];
+        } else {
+            --sp;
+            if (stack[sp - 1] && stack[sp] && FUSED_KERNEL(p[i]) != KERNEL_DIV)
+                return NULL;
+            stack[sp - 1] = false;
+        }
+    }
+
+    SEXP reduction = VECTOR_ELT(program, 2);
+    if (reduction != R_NilValue)
+        return fusedReduce(*INTEGER(reduction), p, length, leaf, n);
+
+    SEXP res = allocVector(REALSXP, n);
+    fusedArithKernel(p, length, leaf, REAL(res), n);
+    return res;
+}
+
+/** One operation of a fused expression, with the same fast cases as the
+ * single instructions.
+ */
+static SEXP arithStep(ArithKernel kernel, SEXP call, SEXP lhs, SEXP rhs,
+                      SEXP env) {
+    static const enum op ops[] = {PLUSOP, MINUSOP, TIMESOP, DIVOP};
+    static const char* const names[] = {"+", "-", "*", "/"};
+    static SEXP prim[4];
+
+    bool overflow = false;
+    SEXP res = vectorArith(ops[kernel], lhs, rhs, &overflow);
+    if (res) {
+        if (overflow) {
+            PROTECT(res);
+            Rf_warningcall(call, INTEGER_OVERFLOW_WARNING);
+            UNPROTECT(1);
+        }
+        return res;
+    }
+    if ((res = complexArith(ops[kernel], lhs, rhs)))
+        return res;
+
+    if (!prim[kernel])
+        prim[kernel] = findFun(Rf_install(names[kernel]), R_GlobalEnv);
+    SEXP args = CONS_NR(lhs, CONS_NR(rhs, R_NilValue));
+    PROTECT(args);
+    res = getBuiltin(prim[kernel])(call, prim[kernel], args, env);
+    UNPROTECT(1);
+    return res;
 }
 
-INSTRUCTION(div_) {
-    SEXP lhs = *ostack_at(ctx, 1);
-    SEXP rhs = *ostack_at(ctx, 0);
-    SEXP res;
+/** Evaluates a fused expression one operation at a time, and the reduction
+ * if there is one. The intermediate values are kept in a list, to protect
+ * them.
+ */
+static SEXP fusedArithFallback(SEXP program, SEXP* leaves, SEXP env) {
+    SEXP code = VECTOR_ELT(program, 0);
+    SEXP calls = VECTOR_ELT(program, 1);
+    const int* p = INTEGER(code);
+    int length = LENGTH(code);
+
+    SEXP stack = PROTECT(allocVector(VECSXP, MAX_FUSED_LEAVES));
+    int sp = 0;
+    int op = 0;
+    for (int i = 0; i < length; ++i) {
+        if (p[i] >= 0) {
+            SET_VECTOR_ELT(stack, sp++, leaves[p[i]]);
+        } else {
+            --sp;
+            SEXP res = arithStep(FUSED_KERNEL(p[i]), VECTOR_ELT(calls, op++),
+                                 VECTOR_ELT(stack, sp - 1),
+                                 VECTOR_ELT(stack, sp), env);
+            SET_VECTOR_ELT(stack, sp - 1, res);
+        }
+    }
+    SEXP res = VECTOR_ELT(stack, 0);
 
-    if (IS_SCALAR_VALUE(lhs, REALSXP) && IS_SCALAR_VALUE(rhs, REALSXP)) {
-        res = Rf_allocVector(REALSXP, 1);
-        *REAL(res) = (*REAL(lhs) == NA_REAL || *REAL(rhs) == NA_REAL)
-                         ? NA_REAL
-                         : *REAL(lhs) / *REAL(rhs);
-    } else if (IS_SCALAR_VALUE(lhs, INTSXP) && IS_SCALAR_VALUE(rhs, INTSXP)) {
-        res = Rf_allocVector(REALSXP, 1);
-        int l = *INTEGER(lhs);
-        int r = *INTEGER(rhs);
-        if (l == NA_INTEGER || r == NA_INTEGER)
-            *REAL(res) = NA_REAL;
-        else
-            *REAL(res) = (double)l / (double)r;
-    } else {
-        BINOP_FALLBACK("/");
+    SEXP reduction = VECTOR_ELT(program, 2);
+    if (reduction != R_NilValue) {
+        // the call of the reduction is the last one
+        res = reduce(VECTOR_ELT(calls, op), *INTEGER(reduction), res, env);
     }
+    UNPROTECT(1);
+    return res;
+}
 
-    ostack_popn(ctx, 2);
+INSTRUCTION(fused_arith_) {
+    SEXP program = readConst(ctx, pc);
+    unsigned nleaves = readImmediate(pc);
+    // the leaves are on the stack, first one deepest
+    SEXP* leaves = ostack_at(ctx, nleaves - 1);
+
+    SEXP res = fusedArith(program, leaves, nleaves);
+    if (!res)
+        res = fusedArithFallback(program, leaves, env);
+    R_Visible = TRUE;
+
+    ostack_popn(ctx, nleaves);
     ostack_push(ctx, res);
 }
 
@@ -1931,7 +3950,19 @@ INSTRUCTION(pow_) {
     SEXP rhs = *ostack_at(ctx, 0);
     SEXP res;
 
-    BINOP_FALLBACK("^");
+    // R_pow squares inline and handles 1^y, x^0 and double NAs the way
+    // arithmetic.c does. Integer NAs yield NA (not NaN) unless 1^y or x^0.
+    double l, r;
+    if (TYPEOF(lhs) != LGLSXP && TYPEOF(rhs) != LGLSXP &&
+        scalarNumber(lhs, &l) && scalarNumber(rhs, &r)) {
+        bool intNA =
+            (TYPEOF(lhs) == INTSXP && *INTEGER(lhs) == NA_INTEGER) ||
+            (TYPEOF(rhs) == INTSXP && *INTEGER(rhs) == NA_INTEGER);
+        res = Rf_allocVector(REALSXP, 1);
+        *REAL(res) = (intNA && l != 1 && r != 0) ? NA_REAL : R_pow(l, r);
+    } else {
+        BINOP_FALLBACK("^");
+    }
 
     ostack_popn(ctx, 2);
     ostack_push(ctx, res);
@@ -2000,40 +4031,381 @@ INSTRUCTION(sub_) {
     ostack_push(ctx, res);
 }
 
-INSTRUCTION(lt_) {
-    SEXP lhs = *ostack_at(ctx, 1);
-    SEXP rhs = *ostack_at(ctx, 0);
+/** Equality of two scalar strings. Returns -1 if it cannot be decided
+ * without the generic version. All CHARSXPs are interned in the global
+ * cache, so two different CHARSXPs with the same encoding must differ.
+ */
+INLINE int scalarStringEq(SEXP lhs, SEXP rhs) {
+    if (!IS_SCALAR_VALUE(lhs, STRSXP) || !IS_SCALAR_VALUE(rhs, STRSXP))
+        return -1;
+    SEXP l = STRING_ELT(lhs, 0);
+    SEXP r = STRING_ELT(rhs, 0);
+    if (l == NA_STRING || r == NA_STRING)
+        return NA_LOGICAL;
+    if (l == r)
+        return TRUE;
+    if (getCharCE(l) == getCharCE(r))
+        return FALSE;
+    return -1;
+}
+
+#define DO_RELOP(op, kernel, opSym)                                            \
+    do {                                                                       \
+        double l, r;                                                           \
+        if (scalarNumber(lhs, &l) && scalarNumber(rhs, &r)) {                  \
+            if (ISNAN(l) || ISNAN(r))                                          \
+                res = R_LogicalNAValue;                                        \
+            else                                                               \
+                res = l op r ? R_TrueValue : R_FalseValue;                     \
+            break;                                                             \
+        }                                                                      \
+        if ((res = vectorCompare(kernel, lhs, rhs)))                           \
+            break;                                                             \
+        BINOP_FALLBACK(opSym);                                                 \
+    } while (false)
+
+#define DO_EQOP(op, kernel, opSym)                                             \
+    do {                                                                       \
+        int eq = scalarStringEq(lhs, rhs);                                     \
+        if (eq == -1) {                                                        \
+            DO_RELOP(op, kernel, opSym);                                       \
+        } else if (eq == NA_LOGICAL) {                                         \
+            res = R_LogicalNAValue;                                            \
+        } else {                                                               \
+            res = (eq op TRUE) ? R_TrueValue : R_FalseValue;                   \
+        }                                                                      \
+    } while (false)
+
+#define RELOP_INSTRUCTION(name, DO, op, kernel, opSym)                         \
+    INSTRUCTION(name) {                                                        \
+        SEXP lhs = *ostack_at(ctx, 1);                                         \
+        SEXP rhs = *ostack_at(ctx, 0);                                         \
+        SEXP res;                                                              \
+                                                                               \
+        DO(op, kernel, opSym);                                                 \
+                                                                               \
+        ostack_popn(ctx, 2);                                                   \
+        ostack_push(ctx, res);                                                 \
+    }
+
+RELOP_INSTRUCTION(lt_, DO_RELOP, <, KERNEL_LT, "<")
+RELOP_INSTRUCTION(gt_, DO_RELOP, >, KERNEL_GT, ">")
+RELOP_INSTRUCTION(le_, DO_RELOP, <=, KERNEL_LE, "<=")
+RELOP_INSTRUCTION(ge_, DO_RELOP, >=, KERNEL_GE, ">=")
+RELOP_INSTRUCTION(eq_, DO_EQOP, ==, KERNEL_EQ, "==")
+RELOP_INSTRUCTION(ne_, DO_EQOP, !=, KERNEL_NE, "!=")
+
+#undef RELOP_INSTRUCTION
+#undef DO_EQOP
+#undef DO_RELOP
+
+/** abs(val) or Mod(val) on attribute-free numerical vectors. abs keeps
+ * integers and logicals integer, Mod always returns doubles. For complex
+ * vectors both compute the modulus. Returns NULL if the generic version has
+ * to be used.
+ */
+INLINE SEXP absVector(SEXP val, bool modulus) {
+    if (ATTRIB(val) != R_NilValue)
+        return NULL;
+
+    R_xlen_t n = XLENGTH(val);
+    SEXP res;
+    switch (TYPEOF(val)) {
+    case CPLXSXP: {
+        res = allocVector(REALSXP, n);
+        const Rcomplex* x = COMPLEX(val);
+        double* r = REAL(res);
+        for (R_xlen_t i = 0; i < n; ++i)
+            r[i] = hypot(x[i].r, x[i].i);
+        break;
+    }
+    case REALSXP: {
+        res = allocVector(REALSXP, n);
+        const double* x = REAL(val);
+        double* r = REAL(res);
+        for (R_xlen_t i = 0; i < n; ++i)
+            r[i] = fabs(x[i]);
+        break;
+    }
+    case INTSXP:
+    case LGLSXP: {
+        const int* x = TYPEOF(val) == INTSXP ? INTEGER(val) : LOGICAL(val);
+        if (modulus) {
+            res = allocVector(REALSXP, n);
+            double* r = REAL(res);
+            for (R_xlen_t i = 0; i < n; ++i)
+                r[i] = x[i] == NA_INTEGER ? NA_REAL : fabs((double)x[i]);
+        } else {
+            res = allocVector(INTSXP, n);
+            int* r = INTEGER(res);
+            for (R_xlen_t i = 0; i < n; ++i)
+                r[i] = x[i] == NA_INTEGER ? NA_INTEGER : abs(x[i]);
+        }
+        break;
+    }
+    default:
+        return NULL;
+    }
+    return res;
+}
+
+INSTRUCTION(abs_) {
+    SEXP val = ostack_top(ctx);
+    SEXP res = absVector(val, false);
+    if (!res)
+        UNOP_FALLBACK("abs");
+
+    ostack_pop(ctx);
+    ostack_push(ctx, res);
+}
+
+INSTRUCTION(modulus_) {
+    SEXP val = ostack_top(ctx);
+    SEXP res = absVector(val, true);
+    if (!res)
+        UNOP_FALLBACK("Mod");
+
+    ostack_pop(ctx);
+    ostack_push(ctx, res);
+}
+
+static double (*const math1Impl[])(double) = {
+#define V(name, cfun) cfun,
+    MATH1_FUNCTIONS(V)
+#undef V
+};
+
+static const char* const math1Name[] = {
+#define V(name, cfun) #name,
+    MATH1_FUNCTIONS(V)
+#undef V
+};
+
+/** Applies fun to every element of an attribute-free double, integer or
+ * logical vector. Returns NULL if the generic version has to be used, which
+ * includes results that are NaN for a non NaN input, since the builtin warns
+ * about those.
+ */
+INLINE SEXP math1Vector(double (*fun)(double), SEXP val) {
+    SEXPTYPE vectorT = TYPEOF(val);
+    if ((vectorT != REALSXP && vectorT != INTSXP && vectorT != LGLSXP) ||
+        ATTRIB(val) != R_NilValue)
+        return NULL;
+
+    R_xlen_t n = XLENGTH(val);
+    SEXP res = allocVector(REALSXP, n);
+    bool newNaN;
+    if (vectorT == REALSXP)
+        newNaN = realMath1Kernel(fun, REAL(res), n, REAL(val));
+    else
+        newNaN = intMath1Kernel(
+            fun, REAL(res), n,
+            vectorT == INTSXP ? INTEGER(val) : LOGICAL(val));
+    return newNaN ? NULL : res;
+}
+
+static SEXP math1Fallback(SEXP call, unsigned fun, SEXP val, SEXP env) {
+    static SEXP prim[numMath1_];
+    if (!prim[fun])
+        prim[fun] = findFun(Rf_install(math1Name[fun]), R_BaseEnv);
+
+    // log is a special, it gets the already evaluated argument as a promise
+    SEXP arg = TYPEOF(prim[fun]) == SPECIALSXP ? forcedPromise(val) : val;
+    PROTECT(arg);
+    SEXP args = CONS_NR(arg, R_NilValue);
+    UNPROTECT(1);
+    PROTECT(args);
+    SEXP res = getBuiltin(prim[fun])(call, prim[fun], args, env);
+    UNPROTECT(1);
+    return res;
+}
+
+INSTRUCTION(math1_) {
+    unsigned fun = readImmediate(pc);
+    SEXP val = ostack_top(ctx);
+
+    SEXP res = math1Vector(math1Impl[fun], val);
+    if (!res)
+        res = math1Fallback(getSrcForCall(c, *pc - 1 - sizeof(Immediate), ctx),
+                            fun, val, env);
+    R_Visible = TRUE;
+
+    ostack_pop(ctx);
+    ostack_push(ctx, res);
+}
+
+INSTRUCTION(reduce_) {
+    Reduction kind = readImmediate(pc);
+    SEXP val = ostack_top(ctx);
+
+    bool overflow = false;
+    SEXP res = reduceVector(kind, val, &overflow);
+    if (!res || overflow) {
+        SEXP call = getSrcForCall(c, *pc - 1 - sizeof(Immediate), ctx);
+        if (res) {
+            PROTECT(res);
+            Rf_warningcall(call, SUM_OVERFLOW_WARNING);
+            UNPROTECT(1);
+        } else {
+            res = reduceFallback(call, kind, val, env);
+        }
+    }
+    R_Visible = TRUE;
+
+    ostack_pop(ctx);
+    ostack_push(ctx, res);
+}
+
+INSTRUCTION(uminus_) {
+    SEXP val = ostack_top(ctx);
     SEXP res;
 
-    do {
-        if (IS_SCALAR_VALUE(lhs, REALSXP)) {
-            if (IS_SCALAR_VALUE(rhs, REALSXP)) {
-                if (*REAL(lhs) == NA_REAL || *REAL(rhs) == NA_REAL) {
-                    res = R_LogicalNAValue;
-                } else {
-                    res = *REAL(lhs) < *REAL(rhs) ? R_TrueValue : R_FalseValue;
-                }
-                break;
-            }
-        } else if (IS_SCALAR_VALUE(lhs, INTSXP)) {
-            if (IS_SCALAR_VALUE(rhs, INTSXP)) {
-                if (*INTEGER(lhs) == NA_INTEGER ||
-                    *INTEGER(rhs) == NA_INTEGER) {
-                    res = R_LogicalNAValue;
-                } else {
-                    res = *INTEGER(lhs) < *INTEGER(rhs) ? R_TrueValue
-                                                        : R_FalseValue;
-                }
-                break;
+    SEXPTYPE vectorT = TYPEOF(val);
+    if ((vectorT == REALSXP || vectorT == INTSXP || vectorT == LGLSXP) &&
+        ATTRIB(val) == R_NilValue) {
+        R_xlen_t n = XLENGTH(val);
+        if (vectorT == REALSXP) {
+            res = allocVector(REALSXP, n);
+            const double* x = REAL(val);
+            double* r = REAL(res);
+            for (R_xlen_t i = 0; i < n; ++i)
+                r[i] = -x[i];
+        } else {
+            // -TRUE is an integer
+            res = allocVector(INTSXP, n);
+            const int* x = vectorT == INTSXP ? INTEGER(val) : LOGICAL(val);
+            int* r = INTEGER(res);
+            for (R_xlen_t i = 0; i < n; ++i)
+                r[i] = x[i] == NA_INTEGER ? NA_INTEGER : -x[i];
+        }
+    } else {
+        UNOP_FALLBACK("-");
+    }
+
+    ostack_pop(ctx);
+    ostack_push(ctx, res);
+}
+
+/** Reads element i of a logical, integer or real vector as a ternary
+ * logical, the same way the logical operators coerce their arguments.
+ */
+INLINE int ternaryElt(SEXP x, R_xlen_t i) {
+    switch (TYPEOF(x)) {
+    case LGLSXP: {
+        int v = LOGICAL(x)[i];
+        return v == NA_LOGICAL ? NA_LOGICAL : v != 0;
+    }
+    case INTSXP: {
+        int v = INTEGER(x)[i];
+        return v == NA_INTEGER ? NA_LOGICAL : v != 0;
+    }
+    case REALSXP: {
+        double v = REAL(x)[i];
+        return ISNAN(v) ? NA_LOGICAL : v != 0;
+    }
+    default:
+        assert(false);
+        return NA_LOGICAL;
+    }
+}
+
+INLINE bool isPlainLogicalOperand(SEXP x) {
+    SEXPTYPE t = TYPEOF(x);
+    return (t == LGLSXP || t == INTSXP || t == REALSXP) &&
+           ATTRIB(x) == R_NilValue;
+}
+
+INLINE SEXP scalarTernary(int v) {
+    return v == NA_LOGICAL ? R_LogicalNAValue
+                           : (v ? R_TrueValue : R_FalseValue);
+}
+
+INSTRUCTION(not_) {
+    SEXP val = ostack_top(ctx);
+    SEXP res;
+
+    if (isPlainLogicalOperand(val)) {
+        R_xlen_t n = XLENGTH(val);
+        if (n == 1) {
+            int v = ternaryElt(val, 0);
+            res = scalarTernary(v == NA_LOGICAL ? v : !v);
+        } else {
+            res = allocVector(LGLSXP, n);
+            int* r = LOGICAL(res);
+            for (R_xlen_t i = 0; i < n; ++i) {
+                int v = ternaryElt(val, i);
+                r[i] = v == NA_LOGICAL ? v : !v;
             }
         }
-        BINOP_FALLBACK("<");
-    } while (false);
+    } else {
+        UNOP_FALLBACK("!");
+    }
+
+    ostack_pop(ctx);
+    ostack_push(ctx, res);
+}
+
+INLINE int ternaryAnd(int l, int r) {
+    if (l == 0 || r == 0)
+        return 0;
+    return (l == NA_LOGICAL || r == NA_LOGICAL) ? NA_LOGICAL : 1;
+}
+
+INLINE int ternaryOr(int l, int r) {
+    if (l == 1 || r == 1)
+        return 1;
+    return (l == NA_LOGICAL || r == NA_LOGICAL) ? NA_LOGICAL : 0;
+}
+
+// Elementwise & and |, for operands of the same length or a scalar operand
+// recycled against a vector. Anything that would warn is left to the builtin.
+#define DO_LGLOP(combine, opSym)                                               \
+    do {                                                                       \
+        if (isPlainLogicalOperand(lhs) && isPlainLogicalOperand(rhs)) {        \
+            R_xlen_t nl = XLENGTH(lhs);                                        \
+            R_xlen_t nr = XLENGTH(rhs);                                        \
+            if (nl == nr || (nl == 1 && nr > 0) || (nr == 1 && nl > 0)) {      \
+                R_xlen_t n = nl > nr ? nl : nr;                                \
+                if (n == 1) {                                                  \
+                    res = scalarTernary(                                       \
+                        combine(ternaryElt(lhs, 0), ternaryElt(rhs, 0)));      \
+                    break;                                                     \
+                }                                                              \
+                res = allocVector(LGLSXP, n);                                  \
+                int* r = LOGICAL(res);                                         \
+                for (R_xlen_t i = 0; i < n; ++i)                               \
+                    r[i] = combine(ternaryElt(lhs, nl == 1 ? 0 : i),           \
+                                   ternaryElt(rhs, nr == 1 ? 0 : i));          \
+                break;                                                         \
+            }                                                                  \
+        }                                                                      \
+        BINOP_FALLBACK(opSym);                                                 \
+    } while (false)
+
+INSTRUCTION(and_) {
+    SEXP lhs = *ostack_at(ctx, 1);
+    SEXP rhs = *ostack_at(ctx, 0);
+    SEXP res;
+
+    DO_LGLOP(ternaryAnd, "&");
+
+    ostack_popn(ctx, 2);
+    ostack_push(ctx, res);
+}
+
+INSTRUCTION(or_) {
+    SEXP lhs = *ostack_at(ctx, 1);
+    SEXP rhs = *ostack_at(ctx, 0);
+    SEXP res;
+
+    DO_LGLOP(ternaryOr, "|");
 
     ostack_popn(ctx, 2);
     ostack_push(ctx, res);
 }
 
+#undef DO_LGLOP
+
 INSTRUCTION(names_) {
     ostack_push(ctx, getAttrib(ostack_pop(ctx), R_NamesSymbol));
 }
@@ -2052,6 +4424,85 @@ INSTRUCTION(alloc_) {
     ostack_push(ctx, vec);
 }
 
+INSTRUCTION(alloc_as_) {
+    SEXP t = ostack_pop(ctx);
+    SEXP l = ostack_pop(ctx);
+    assert(TYPEOF(l) == INTSXP);
+    if (!Rf_isVectorAtomic(t) || XLENGTH(t) != 1 || ATTRIB(t) != R_NilValue) {
+        ostack_push(ctx, R_NilValue);
+        return;
+    }
+    ostack_push(ctx, Rf_allocVector(TYPEOF(t), INTEGER(l)[0]));
+}
+
+INSTRUCTION(set_elt_) {
+    SEXP vec = ostack_pop(ctx);
+    SEXP idx = ostack_pop(ctx);
+    SEXP val = ostack_pop(ctx);
+    assert(TYPEOF(idx) == INTSXP);
+    int i = INTEGER(idx)[0] - 1;
+
+    if (TYPEOF(vec) == VECSXP) {
+        val = escape(val);
+        if (MAYBE_REFERENCED(val))
+            val = Rf_lazy_duplicate(val);
+        SET_VECTOR_ELT(vec, i, val);
+        ostack_push(ctx, vec);
+        return;
+    }
+
+    // Same checks as do_vapply
+    SEXPTYPE type = TYPEOF(vec);
+    SEXPTYPE valType = TYPEOF(val);
+    if (Rf_length(val) != 1)
+        error("values must be length 1,\n but FUN(X[[%d]]) result is length %d",
+              i + 1, Rf_length(val));
+    if (valType != type) {
+        bool okay = false;
+        switch (type) {
+        case CPLXSXP:
+            okay = valType == REALSXP || valType == INTSXP ||
+                   valType == LGLSXP;
+            break;
+        case REALSXP:
+            okay = valType == INTSXP || valType == LGLSXP;
+            break;
+        case INTSXP:
+            okay = valType == LGLSXP;
+            break;
+        }
+        if (!okay)
+            error("values must be type '%s',\n but FUN(X[[%d]]) result is "
+                  "type '%s'",
+                  type2char(type), i + 1, type2char(valType));
+        val = Rf_coerceVector(val, type);
+    }
+
+    switch (type) {
+    case LGLSXP:
+        LOGICAL(vec)[i] = LOGICAL(val)[0];
+        break;
+    case INTSXP:
+        INTEGER(vec)[i] = INTEGER(val)[0];
+        break;
+    case REALSXP:
+        REAL(vec)[i] = REAL(val)[0];
+        break;
+    case CPLXSXP:
+        COMPLEX(vec)[i] = COMPLEX(val)[0];
+        break;
+    case STRSXP:
+        SET_STRING_ELT(vec, i, STRING_ELT(val, 0));
+        break;
+    case RAWSXP:
+        RAW(vec)[i] = RAW(val)[0];
+        break;
+    default:
+        assert(false);
+    }
+    ostack_push(ctx, vec);
+}
+
 INSTRUCTION(length_) {
     SEXP t = ostack_pop(ctx);
     int len = XLENGTH(t);
@@ -2185,6 +4636,29 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP env, unsigned numArgs) {
 
     OpcodeT* pc = code(c);
 
+    // Frames of the stackless calls made by this invocation are above
+    // frameBase. Their contexts get a copy of frameJump, which is only set up
+    // once there is a call.
+#if STACKLESS_CALLS
+    dropStaleFrames(ctx);
+#endif
+    size_t frameBase = ctx->frameCount;
+    size_t depth = frameBase;
+#if STACKLESS_CALLS
+    bool armed = false;
+    JMP_BUF frameJump;
+#endif
+
+// Continues in the state saved in a frame
+#define RESUME(f)                                                              \
+    do {                                                                       \
+        c = (f)->code;                                                         \
+        env = (f)->env;                                                        \
+        pc = (f)->pc;                                                          \
+        bp = (f)->bp;                                                          \
+        numArgs = (f)->numArgs;                                                \
+    } while (false)
+
     R_Visible = TRUE;
     // main loop
     while (true) {
@@ -2211,21 +4685,41 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP env, unsigned numArgs) {
             INS(idiv_);
             INS(sub_);
             INS(lt_);
-            INS(call_);
+            INS(gt_);
+            INS(le_);
+            INS(ge_);
+            INS(eq_);
+            INS(ne_);
+            INS(uminus_);
+            INS(not_);
+            INS(and_);
+            INS(or_);
+            INS(abs_);
+            INS(modulus_);
+            INS(math1_);
+            INS(reduce_);
+            INS(fused_arith_);
             INS(call_stack_);
             INS(static_call_stack_);
             INS(dispatch_stack_);
             INS(promise_);
             INS(push_code_);
+            INS(lazy_);
             INS(close_);
             INS(force_);
             INS(pop_);
-            INS(return_);
             INS(asast_);
             INS(stvar_);
+            INS(unbind_);
             INS(missing_);
             INS(subassign_);
             INS(subassign2_);
+            INS(subassign_mat_);
+            INS(subassign2_mat_);
+            INS(dollar_);
+            INS(extract_name_);
+            INS(subassign_dollar_);
+            INS(subassign2_name_);
             INS(asbool_);
             INS(brobj_);
             INS(endcontext_);
@@ -2248,30 +4742,106 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP env, unsigned numArgs) {
             INS(invisible_);
             INS(visible_);
             INS(extract1_);
+            INS(extract1_real_);
             INS(subset1_);
             INS(extract2_);
             INS(subset2_);
             INS(dispatch_);
+            INS(std_generic_);
             INS(uniq_);
             INS(aslogical_);
             INS(lgl_and_);
             INS(lgl_or_);
             INS(names_);
             INS(set_names_);
+            INS(alloc_as_);
+            INS(set_elt_);
             INS(alloc_);
             INS(length_);
 
+#if STACKLESS_CALLS
+        case call_:
+        case call_pic_: {
+            bool pic = *(pc - sizeof(OpcodeT)) == call_pic_;
+            if (!stacklessCallee(ostack_top(ctx))) {
+                if (pic)
+                    ins_call_pic_(c, env, &pc, ctx, numArgs, &c);
+                else
+                    ins_call_(c, env, &pc, ctx, numArgs, &c);
+                break;
+            }
+
+            if (!armed) {
+                armed = true;
+                if (SETJMP(frameJump)) {
+                    // incomming longjmp to the context of one of our calls,
+                    // ie. return() from a promise or a restart. The locals
+                    // are lost, the frames have everything.
+                    depth = ctx->frameCount;
+                    while (depth > frameBase &&
+                           ctx->frames[depth - 1].cntxt != R_GlobalContext)
+                        --depth;
+                    assert(depth > frameBase && "stack botched");
+                    Frame* f = &ctx->frames[depth - 1];
+                    R_PPStackTop = f->ppStackTop;
+
+                    if (R_ReturnedValue == R_RestartToken) {
+                        R_GlobalContext->callflag = CTXT_RETURN;
+                        R_ReturnedValue = R_NilValue;
+                        ctx->frameCount = depth;
+                        c = functionCode(f->fun);
+                        env = *ostack_at(ctx, 1);
+                        pc = code(c);
+                        numArgs = f->nargs;
+                        bp = ostack_length(ctx);
+                    } else {
+                        f = stacklessReturn(R_ReturnedValue, depth--, ctx);
+                        RESUME(f);
+                    }
+                    break;
+                }
+            }
+
+            Frame* f =
+                stacklessCall(c, env, &pc, pic, depth, frameJump, ctx);
+            f->code = c;
+            f->env = env;
+            f->pc = pc;
+            f->bp = bp;
+            f->numArgs = numArgs;
+            ++depth;
+
+            c = functionCode(f->fun);
+            env = *ostack_at(ctx, 1);
+            pc = code(c);
+            numArgs = f->nargs;
+            ostack_ensureSize(ctx, c->stackLength + 5);
+            bp = ostack_length(ctx);
+            R_Visible = TRUE;
+            break;
+        }
+#else
+            INS(call_);
+            INS(call_pic_);
+#endif
+
         case beginloop_: {
             // Allocate a RCNTXT on the stack
-            SEXP cntxt_store =
-                Rf_allocVector(RAWSXP, sizeof(RCNTXT) + sizeof(pc));
+            SEXP cntxt_store = Rf_allocVector(
+                RAWSXP, sizeof(RCNTXT) + sizeof(Frame) + sizeof(depth));
             ostack_push(ctx, cntxt_store);
 
             RCNTXT* cntxt = (RCNTXT*)RAW(cntxt_store);
 
-            // (ab)use the same buffe to store the current pc
-            OpcodeT** oldPc = (OpcodeT**)(cntxt + 1);
-            *oldPc = pc;
+            // (ab)use the same buffer to store the state to resume in, since
+            // the locals are lost after a longjmp across stackless calls
+            Frame* loop = (Frame*)(cntxt + 1);
+            loop->code = c;
+            loop->env = env;
+            loop->pc = pc;
+            loop->bp = bp;
+            loop->numArgs = numArgs;
+            *(size_t*)(loop + 1) = depth;
 
             Rf_begincontext(cntxt, CTXT_LOOP, R_NilValue, env, R_BaseEnv,
                             R_NilValue, R_NilValue);
@@ -2290,8 +4860,10 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP env, unsigned numArgs) {
                 assert(TYPEOF(cntxt_store) == RAWSXP && "stack botched");
                 RCNTXT* cntxt = (RCNTXT*)RAW(cntxt_store);
                 assert(cntxt == R_GlobalContext && "stack botched");
-                OpcodeT** oldPc = (OpcodeT**)(cntxt + 1);
-                pc = *oldPc;
+                Frame* loop = (Frame*)(cntxt + 1);
+                RESUME(loop);
+                depth = *(size_t*)(loop + 1);
+                ctx->frameCount = depth;
 
                 int offset = readJumpOffset(&pc);
 
@@ -2302,8 +4874,30 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP env, unsigned numArgs) {
             break;
         }
 
+#if STACKLESS_CALLS
+        case return_:
+            if (depth == frameBase ||
+                ctx->frames[depth - 1].cntxt != R_GlobalContext) {
+                ins_return_(c, env, &pc, ctx, numArgs, &c);
+                break;
+            }
+            // return() from the body of a stackless call needs no longjmp
+            // fall through
+#else
+            INS(return_);
+#endif
+
         case ret_: {
             // not in its own function so that we can avoid nonlocal returns
+#if STACKLESS_CALLS
+            if (depth > frameBase) {
+                SEXP result = ostack_pop(ctx);
+                ostack_popn(ctx, ostack_length(ctx) - bp);
+                Frame* f = stacklessReturn(result, depth--, ctx);
+                RESUME(f);
+                break;
+            }
+#endif
             goto __eval_done;
         }
         default:
@@ -2313,6 +4907,7 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP env, unsigned numArgs) {
 __eval_done : {
     return ostack_pop(ctx);
 }
+#undef RESUME
 }
 
 
@@ -2400,7 +4995,7 @@ SEXP rirEval(SEXP e, SEXP env) {
 
     case BCODESXP: {
         SEXP expr = VECTOR_ELT(CDR(e), 0);
-        SEXP code = globalContext()->compiler(expr);
+        SEXP code = evalCacheCompile(expr, globalContext());
         PROTECT(code);
         Function* ff = (Function*)(INTEGER(code));
         SEXP res = evalRirCode(functionCode(ff), globalContext(), env, 0);
@@ -2442,7 +5037,7 @@ SEXP rirEval(SEXP e, SEXP env) {
         return promiseValue(e, globalContext());
 
     case LANGSXP: {
-        SEXP code = globalContext()->compiler(e);
+        SEXP code = evalCacheCompile(e, globalContext());
         PROTECT(code);
         Function* ff = (Function*)(INTEGER(code));
         SEXP res = evalRirCode(functionCode(ff), globalContext(), env, 0);
@@ -12,6 +12,7 @@ SEXP R_Subset2Sym;
 SEXP R_SubsetSym;
 SEXP R_SubassignSym;
 SEXP R_Subassign2Sym;
+SEXP R_DollarAssignSym;
 SEXP R_valueSym;
 SEXP setterPlaceholderSym;
 SEXP getterPlaceholderSym;
@@ -23,6 +24,9 @@ Context* context_create(CompilerCallback compiler,
     c->list = Rf_allocVector(VECSXP, 2);
     c->optimizer = optimizer;
     c->compiler = compiler;
+    c->frames = malloc(FRAME_CAPACITY * sizeof(Frame));
+    c->frameCount = 0;
+    c->frameCapacity = FRAME_CAPACITY;
     R_PreserveObject(c->list);
     initializeResizeableList(&c->cp, POOL_CAPACITY, c->list, CONTEXT_INDEX_CP);
     initializeResizeableList(&c->src, POOL_CAPACITY, c->list, CONTEXT_INDEX_SRC);
@@ -33,6 +37,7 @@ Context* context_create(CompilerCallback compiler,
     R_SubsetSym = Rf_install("[");
     R_SubassignSym = Rf_install("[<-");
     R_Subassign2Sym = Rf_install("[[<-");
+    R_DollarAssignSym = Rf_install("$<-");
     R_valueSym = Rf_install("value");
     setterPlaceholderSym = Rf_install("*.placeholder.setter.*");
     getterPlaceholderSym = Rf_install("*.placeholder.getter.*");
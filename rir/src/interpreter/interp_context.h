@@ -7,6 +7,7 @@
 #include <stdio.h>
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <assert.h>
 
 /** Compiler API. Given a language object, compiles it and returns the INTSXP containing the Function and its Code objects.
@@ -22,6 +23,7 @@ extern "C" {
 
 #define POOL_CAPACITY 4096
 #define STACK_CAPACITY 4096
+#define FRAME_CAPACITY 256
 
 /** Resizeable R list.
 
@@ -35,12 +37,24 @@ typedef struct {
 } ResizeableList;
 
 /** Interpreter frame information.
+
+ Calls to rir closures from the interpreter loop do not recurse in C, instead
+ the state of the caller is saved in a frame, together with what is needed to
+ finish the call once the callee returns. The R context of the call is on the
+ stack.
  */
 typedef struct {
     struct Code* code;
     SEXP env;
     OpcodeT* pc;
     size_t bp;
+    unsigned numArgs;
+    SEXP call;
+    SEXP callee;
+    struct Function* fun;
+    unsigned nargs;
+    void* cntxt;
+    int ppStackTop; // protection stack of the caller
 } Frame;
 
 #define CONTEXT_INDEX_CP 0
@@ -58,6 +72,9 @@ typedef struct {
     ResizeableList src;
     CompilerCallback compiler;
     OptimizerCallback optimizer;
+    Frame* frames;
+    size_t frameCount;
+    size_t frameCapacity;
 } Context;
 
 // Some symbols
@@ -65,6 +82,7 @@ extern SEXP R_Subset2Sym;
 extern SEXP R_SubsetSym;
 extern SEXP R_SubassignSym;
 extern SEXP R_Subassign2Sym;
+extern SEXP R_DollarAssignSym;
 extern SEXP R_valueSym;
 extern SEXP setterPlaceholderSym;
 extern SEXP getterPlaceholderSym;
@@ -140,6 +158,14 @@ INLINE void ostack_ensureSize(Context* c, unsigned minFree) {
 
 Context* context_create(CompilerCallback, OptimizerCallback);
 
+INLINE Frame* frame_push(Context* c) {
+    if (c->frameCount == c->frameCapacity) {
+        c->frameCapacity *= 2;
+        c->frames = (Frame*)realloc(c->frames, c->frameCapacity * sizeof(Frame));
+    }
+    return &c->frames[c->frameCount++];
+}
+
 INLINE size_t cp_pool_length(Context * c) {
     return rl_length(& c->cp);
 }
@@ -70,6 +70,42 @@ typedef int32_t JumpOffset;
 typedef unsigned FunctionIndex;
 typedef unsigned ArgumentsCount;
 
+// Unary math functions implemented by the math1_ instruction, as pairs of
+// the R name and the C function computing it on doubles
+#define MATH1_FUNCTIONS(V)                                                     \
+    V(sqrt, sqrt)                                                              \
+    V(exp, exp)                                                                \
+    V(log, log)                                                                \
+    V(floor, floor)                                                            \
+    V(ceiling, ceil)                                                           \
+    V(sin, sin)                                                                \
+    V(cos, cos)                                                                \
+    V(tan, tan)
+
+typedef enum {
+#define V(name, cfun) MATH1_##name,
+    MATH1_FUNCTIONS(V)
+#undef V
+    numMath1_
+} Math1Fun;
+
+// Reductions of a single vector implemented by the reduce_ instruction
+#define REDUCTIONS(V)                                                          \
+    V(sum)                                                                     \
+    V(prod)                                                                    \
+    V(min)                                                                     \
+    V(max)                                                                     \
+    V(mean)                                                                    \
+    V(any)                                                                     \
+    V(all)
+
+typedef enum {
+#define V(name) REDUCE_##name,
+    REDUCTIONS(V)
+#undef V
+    numReductions_
+} Reduction;
+
 // enums in C are not namespaces so I am using OP_ to disambiguate
 typedef enum {
 #define DEF_INSTR(name, ...) name,
@@ -185,7 +221,11 @@ typedef struct {
     uint32_t hasTarget : 1;
     uint32_t hasImmediateArgs : 1;
     uint32_t hasProfile : 1;
-    uint32_t free : 27;
+    // The first argument is forced before the callee runs, like
+    // R_forceAndCall does for the apply functions
+    uint32_t forceFirstArg : 1;
+    uint32_t hasInlineCache : 1;
+    uint32_t free : 25;
 
     // This is duplicated in the BC instruction, not sure how to avoid
     // without making accessing the payload a pain...
@@ -203,6 +243,7 @@ typedef struct {
      * nargs * promise offset    if hasImmediateArgs
      * nargs * cp_idx of names   if hasNames
      * CallSiteProfile           if hasProfile
+     * cp_idx of dispatch cache  if hasSelector
      *
      */
 
@@ -220,6 +261,12 @@ INLINE uint32_t* CallSite_target(CallSiteStruct* cs) {
     return &cs->trg;
 }
 
+// The closures a call_pic_ is specialized for, as a list in the pool
+INLINE uint32_t* CallSite_inlineCache(CallSiteStruct* cs) {
+    assert(cs->hasInlineCache);
+    return &cs->trg;
+}
+
 INLINE uint32_t* CallSite_names(CallSiteStruct* cs) {
     assert(cs->hasNames);
     return &cs->payload[(cs->hasImmediateArgs ? cs->nargs : 0)];
@@ -237,17 +284,31 @@ INLINE CallSiteProfile* CallSite_profile(CallSiteStruct* cs) {
                   (cs->hasNames ? cs->nargs : 0)];
 }
 
+// The S3 methods found for the receivers of a dispatch site, a list of
+// DISPATCH_CACHE_SIZE entries in the pool (see dispatchS3 in interp.c)
+INLINE uint32_t* CallSite_dispatchCache(CallSiteStruct* cs) {
+    assert(cs->hasSelector);
+    return (uint32_t*)((char*)&cs
+                           ->payload[(cs->hasImmediateArgs ? cs->nargs : 0) +
+                                     (cs->hasNames ? cs->nargs : 0)] +
+                       (cs->hasProfile ? sizeof(CallSiteProfile) : 0));
+}
+
+#define DISPATCH_CACHE_SIZE 2
+
 INLINE unsigned CallSite_size(bool hasImmediateArgs, bool hasNames,
-                              bool hasProfile, uint32_t nargs) {
+                              bool hasProfile, bool hasSelector,
+                              uint32_t nargs) {
     return sizeof(CallSiteStruct) +
            sizeof(uint32_t) *
                ((hasImmediateArgs ? nargs : 0) + (hasNames ? nargs : 0)) +
-           +(hasProfile ? sizeof(CallSiteProfile) : 0);
+           +(hasProfile ? sizeof(CallSiteProfile) : 0) +
+           (hasSelector ? sizeof(uint32_t) : 0);
 }
 
 INLINE unsigned CallSite_sizeOf(CallSiteStruct* cs) {
     return CallSite_size(cs->hasImmediateArgs, cs->hasNames, cs->hasProfile,
-                         cs->nargs);
+                         cs->hasSelector, cs->nargs);
 }
 
 /** Returns whether the SEXP appears to be valid promise, i.e. a pointer into
@@ -385,7 +446,8 @@ struct Function {
     unsigned envChanged : 1;
     unsigned deopt : 1;
     unsigned markOpt : 1;
-    unsigned spare : 28;
+    unsigned traced : 1; ///< A hot loop of it (or its origin) was traced
+    unsigned spare : 27;
 
     FunctionSEXP origin; /// Same Function with fewer optimizations,
                          //   NULL if original
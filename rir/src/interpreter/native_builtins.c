@@ -0,0 +1,356 @@
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "native_builtins.h"
+#include "R/Funtab.h"
+
+// No dispatch and no attributes to take care of
+static bool isPlain(SEXP x) {
+    return !OBJECT(x) && ATTRIB(x) == R_NilValue;
+}
+
+static bool isAscii(SEXP c) {
+    for (const char* p = CHAR(c); *p; ++p)
+        if ((unsigned char)*p > 127)
+            return false;
+    return true;
+}
+
+// A scalar count, as for the length of vector or the times of rep, that fits
+// into an int. Returns -1 otherwise.
+static int asCount(SEXP x) {
+    if (XLENGTH(x) != 1)
+        return -1;
+    if (TYPEOF(x) == INTSXP) {
+        int v = INTEGER(x)[0];
+        return v == NA_INTEGER || v < 0 ? -1 : v;
+    }
+    if (TYPEOF(x) == REALSXP) {
+        double v = REAL(x)[0];
+        return v >= 0 && v <= INT_MAX && v == floor(v) ? (int)v : -1;
+    }
+    return -1;
+}
+
+// The payload of atomic vectors which are not character
+static char* rawData(SEXP x, size_t* size) {
+    switch (TYPEOF(x)) {
+    case LGLSXP:
+        *size = sizeof(int);
+        return (char*)LOGICAL(x);
+    case INTSXP:
+        *size = sizeof(int);
+        return (char*)INTEGER(x);
+    case REALSXP:
+        *size = sizeof(double);
+        return (char*)REAL(x);
+    case CPLXSXP:
+        *size = sizeof(Rcomplex);
+        return (char*)COMPLEX(x);
+    case RAWSXP:
+        *size = 1;
+        return (char*)RAW(x);
+    default:
+        return NULL;
+    }
+}
+
+static SEXP nativeLength(SEXP* args, unsigned nargs) {
+    if (nargs != 1)
+        return NULL;
+    SEXP x = args[0];
+    if (OBJECT(x) || (!isVector(x) && x != R_NilValue))
+        return NULL;
+    R_xlen_t n = XLENGTH(x);
+    return n > INT_MAX ? ScalarReal((double)n) : ScalarInteger((int)n);
+}
+
+static SEXP nativeIsNull(SEXP* args, unsigned nargs) {
+    if (nargs != 1)
+        return NULL;
+    return args[0] == R_NilValue ? R_TrueValue : R_FalseValue;
+}
+
+static SEXP nativeIsNa(SEXP* args, unsigned nargs) {
+    if (nargs != 1)
+        return NULL;
+    SEXP x = args[0];
+    if (!isPlain(x))
+        return NULL;
+
+    R_xlen_t n = XLENGTH(x);
+    SEXP res;
+    switch (TYPEOF(x)) {
+    case LGLSXP:
+    case INTSXP: {
+        res = allocVector(LGLSXP, n);
+        // NA_LOGICAL == NA_INTEGER
+        const int* v = INTEGER(x);
+        for (R_xlen_t i = 0; i < n; ++i)
+            LOGICAL(res)[i] = v[i] == NA_INTEGER;
+        break;
+    }
+    case REALSXP: {
+        res = allocVector(LGLSXP, n);
+        const double* v = REAL(x);
+        for (R_xlen_t i = 0; i < n; ++i)
+            LOGICAL(res)[i] = ISNAN(v[i]);
+        break;
+    }
+    case STRSXP:
+        res = allocVector(LGLSXP, n);
+        for (R_xlen_t i = 0; i < n; ++i)
+            LOGICAL(res)[i] = STRING_ELT(x, i) == NA_STRING;
+        break;
+    default:
+        return NULL;
+    }
+    return res;
+}
+
+static SEXP nativeC(SEXP* args, unsigned nargs) {
+    // logical < integer < double < character, but we leave the formatting
+    // of numbers as strings to the builtin
+    SEXPTYPE type = NILSXP;
+    R_xlen_t n = 0;
+    for (unsigned i = 0; i < nargs; ++i) {
+        SEXP a = args[i];
+        if (a == R_NilValue)
+            continue;
+        if (!isPlain(a))
+            return NULL;
+        switch (TYPEOF(a)) {
+        case LGLSXP:
+        case INTSXP:
+        case REALSXP:
+        case STRSXP:
+            break;
+        default:
+            return NULL;
+        }
+        if (type != NILSXP && (type == STRSXP) != (TYPEOF(a) == STRSXP))
+            return NULL;
+        if (TYPEOF(a) > type)
+            type = TYPEOF(a);
+        n += XLENGTH(a);
+    }
+    if (type == NILSXP)
+        return R_NilValue;
+
+    SEXP res = allocVector(type, n);
+    R_xlen_t pos = 0;
+    for (unsigned i = 0; i < nargs; ++i) {
+        SEXP a = args[i];
+        if (a == R_NilValue)
+            continue;
+        R_xlen_t l = XLENGTH(a);
+        if (type == STRSXP) {
+            for (R_xlen_t j = 0; j < l; ++j)
+                SET_STRING_ELT(res, pos + j, STRING_ELT(a, j));
+        } else if (type == REALSXP && TYPEOF(a) != REALSXP) {
+            const int* v = INTEGER(a);
+            for (R_xlen_t j = 0; j < l; ++j)
+                REAL(res)[pos + j] = v[j] == NA_INTEGER ? NA_REAL : v[j];
+        } else {
+            // Same representation for logicals and integers
+            size_t size;
+            char* dst = rawData(res, &size);
+            memcpy(dst + pos * size, rawData(a, &size), l * size);
+        }
+        pos += l;
+    }
+    return res;
+}
+
+static SEXP nativeRep(SEXP* args, unsigned nargs) {
+    if (nargs < 1 || nargs > 2)
+        return NULL;
+    SEXP x = args[0];
+    if (!isPlain(x) || !Rf_isVectorAtomic(x))
+        return NULL;
+    int times = nargs == 2 ? asCount(args[1]) : 1;
+    if (times < 0)
+        return NULL;
+    R_xlen_t lx = XLENGTH(x);
+    if (lx > 0 && times > INT_MAX / lx)
+        return NULL;
+
+    SEXP res = allocVector(TYPEOF(x), lx * times);
+    if (TYPEOF(x) == STRSXP) {
+        R_xlen_t pos = 0;
+        for (int t = 0; t < times; ++t)
+            for (R_xlen_t i = 0; i < lx; ++i)
+                SET_STRING_ELT(res, pos++, STRING_ELT(x, i));
+    } else {
+        size_t size;
+        char* src = rawData(x, &size);
+        char* dst = rawData(res, &size);
+        for (int t = 0; t < times; ++t)
+            memcpy(dst + t * lx * size, src, lx * size);
+    }
+    return res;
+}
+
+// .Internal(vector(mode, length))
+static SEXP nativeVector(SEXP* args, unsigned nargs) {
+    if (nargs != 2)
+        return NULL;
+    SEXP mode = args[0];
+    if (TYPEOF(mode) != STRSXP || XLENGTH(mode) != 1)
+        return NULL;
+    int n = asCount(args[1]);
+    if (n < 0)
+        return NULL;
+
+    const char* m = CHAR(STRING_ELT(mode, 0));
+    SEXPTYPE type;
+    if (!strcmp(m, "logical"))
+        type = LGLSXP;
+    else if (!strcmp(m, "integer"))
+        type = INTSXP;
+    else if (!strcmp(m, "numeric") || !strcmp(m, "double"))
+        type = REALSXP;
+    else if (!strcmp(m, "complex"))
+        type = CPLXSXP;
+    else if (!strcmp(m, "character"))
+        type = STRSXP;
+    else if (!strcmp(m, "list"))
+        type = VECSXP;
+    else if (!strcmp(m, "raw"))
+        type = RAWSXP;
+    else
+        return NULL;
+
+    SEXP res = allocVector(type, n);
+    size_t size;
+    char* data = rawData(res, &size);
+    // character vectors and lists are already initialized
+    if (data)
+        memset(data, 0, n * size);
+    return res;
+}
+
+// .Internal(nchar(x, type, allowNA, keepNA)), for types chars and bytes
+static SEXP nativeNchar(SEXP* args, unsigned nargs) {
+    if (nargs != 4)
+        return NULL;
+    SEXP x = args[0];
+    SEXP stype = args[1];
+    SEXP allowNA = args[2];
+    SEXP keepNA = args[3];
+    if (TYPEOF(x) != STRSXP || !isPlain(x))
+        return NULL;
+    if (TYPEOF(stype) != STRSXP || XLENGTH(stype) != 1 ||
+        TYPEOF(allowNA) != LGLSXP || XLENGTH(allowNA) != 1 ||
+        LOGICAL(allowNA)[0] == NA_LOGICAL || TYPEOF(keepNA) != LGLSXP ||
+        XLENGTH(keepNA) != 1)
+        return NULL;
+
+    // Partial matching as in do_nchar
+    const char* type = CHAR(STRING_ELT(stype, 0));
+    size_t ntype = strlen(type);
+    if (ntype == 0)
+        return NULL;
+    bool bytes;
+    if (!strncmp(type, "bytes", ntype))
+        bytes = true;
+    else if (!strncmp(type, "chars", ntype))
+        bytes = false;
+    else
+        return NULL;
+
+    // The default (NA) keeps NAs for chars and bytes
+    int na = LOGICAL(keepNA)[0] == FALSE ? 2 : NA_INTEGER;
+
+    R_xlen_t n = XLENGTH(x);
+    SEXP res = allocVector(INTSXP, n);
+    for (R_xlen_t i = 0; i < n; ++i) {
+        SEXP el = STRING_ELT(x, i);
+        if (el == NA_STRING)
+            INTEGER(res)[i] = na;
+        else if (bytes || isAscii(el))
+            INTEGER(res)[i] = LENGTH(el);
+        else
+            return NULL;
+    }
+    return res;
+}
+
+// .Internal(substr(x, start, stop)), for ASCII strings
+static SEXP nativeSubstr(SEXP* args, unsigned nargs) {
+    if (nargs != 3)
+        return NULL;
+    SEXP x = args[0];
+    SEXP sa = args[1];
+    SEXP so = args[2];
+    if (TYPEOF(x) != STRSXP || !isPlain(x) || TYPEOF(sa) != INTSXP ||
+        TYPEOF(so) != INTSXP || XLENGTH(sa) == 0 || XLENGTH(so) == 0)
+        return NULL;
+
+    R_xlen_t n = XLENGTH(x);
+    R_xlen_t k = XLENGTH(sa);
+    R_xlen_t l = XLENGTH(so);
+    SEXP res = PROTECT(allocVector(STRSXP, n));
+    for (R_xlen_t i = 0; i < n; ++i) {
+        SEXP el = STRING_ELT(x, i);
+        int start = INTEGER(sa)[i % k];
+        int stop = INTEGER(so)[i % l];
+        if (el == NA_STRING || start == NA_INTEGER || stop == NA_INTEGER) {
+            SET_STRING_ELT(res, i, NA_STRING);
+            continue;
+        }
+        if (!isAscii(el)) {
+            UNPROTECT(1);
+            return NULL;
+        }
+        int slen = LENGTH(el);
+        if (start < 1)
+            start = 1;
+        if (start > stop || start > slen) {
+            SET_STRING_ELT(res, i, R_BlankString);
+        } else {
+            if (stop > slen)
+                stop = slen;
+            SET_STRING_ELT(res, i, Rf_mkCharLenCE(CHAR(el) + start - 1,
+                                                  stop - start + 1,
+                                                  getCharCE(el)));
+        }
+    }
+    UNPROTECT(1);
+    return res;
+}
+
+typedef struct {
+    const char* name;
+    NativeBuiltin fun;
+} NativeBuiltinEntry;
+
+static NativeBuiltinEntry nativeBuiltinEntries[] = {
+    {"length", nativeLength}, {"is.null", nativeIsNull},
+    {"is.na", nativeIsNa},    {"c", nativeC},
+    {"rep", nativeRep},       {"vector", nativeVector},
+    {"nchar", nativeNchar},   {"substr", nativeSubstr},
+};
+
+// Indexed by the offset of the builtin in R_FunTab
+static NativeBuiltin* nativeBuiltins = NULL;
+
+static void initializeNativeBuiltins() {
+    int n = 0;
+    while (R_FunTab[n].name)
+        ++n;
+    nativeBuiltins = calloc(n, sizeof(NativeBuiltin));
+    for (size_t i = 0;
+         i < sizeof(nativeBuiltinEntries) / sizeof(NativeBuiltinEntry); ++i) {
+        NativeBuiltinEntry* e = &nativeBuiltinEntries[i];
+        nativeBuiltins[findBuiltin(e->name)] = e->fun;
+    }
+}
+
+NativeBuiltin nativeBuiltin(SEXP builtin) {
+    if (!nativeBuiltins)
+        initializeNativeBuiltins();
+    return nativeBuiltins[((sexprec_rjit*)builtin)->u.i];
+}
@@ -0,0 +1,23 @@
+#ifndef RIR_INTERPRETER_NATIVE_BUILTINS_H
+#define RIR_INTERPRETER_NATIVE_BUILTINS_H
+
+#include "../config.h"
+
+/** Versions of common builtins which take their arguments directly from the
+  stack, instead of the argument pairlist the builtin wants.
+
+  They only cover the plain cases, ie. no dispatch, no attributes to carry
+  over and no coercion R would have to warn about. For everything else they
+  return NULL (the C pointer, R_NilValue is a valid result) and the caller
+  calls the builtin itself, which then also reports the errors.
+
+  The .Internal builtins (vector, nchar, substr) are in the same table,
+  keyed by their offset in R_FunTab.
+ */
+
+typedef SEXP (*NativeBuiltin)(SEXP* args, unsigned nargs);
+
+/** Returns the native version of the builtin, or NULL if there is none. */
+C_OR_CPP NativeBuiltin nativeBuiltin(SEXP builtin);
+
+#endif
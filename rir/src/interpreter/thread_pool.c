@@ -0,0 +1,162 @@
+#include <pthread.h>
+#include <stdint.h>
+
+#include "thread_pool.h"
+
+#define MAX_THREADS 256
+
+// Number of chunks per participating thread, for some load balancing
+#define CHUNKS_PER_THREAD 4
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+
+    int threads;   // configured, including the main thread
+    int started;   // worker threads running, workers above it exit
+    pthread_t workers[MAX_THREADS];
+    unsigned generation;
+
+    // current job
+    ParallelChunk chunk;
+    void* data;
+    R_xlen_t n;
+    R_xlen_t chunkSize;
+    R_xlen_t chunks;
+    R_xlen_t next;    // next chunk to take, updated atomically
+    int participants; // workers taking part in the current job
+    int busy;         // participants not finished yet
+} pool = {PTHREAD_MUTEX_INITIALIZER,
+          PTHREAD_COND_INITIALIZER,
+          PTHREAD_COND_INITIALIZER,
+          1};
+
+static void runChunks() {
+    R_xlen_t i;
+    while ((i = __atomic_fetch_add(&pool.next, 1, __ATOMIC_RELAXED)) <
+           pool.chunks) {
+        R_xlen_t from = i * pool.chunkSize;
+        R_xlen_t to = from + pool.chunkSize;
+        pool.chunk(pool.data, from, to < pool.n ? to : pool.n);
+    }
+}
+
+static void* worker(void* arg) {
+    int id = (int)(intptr_t)arg;
+    unsigned seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&pool.lock);
+        while (pool.generation == seen && id < pool.started)
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        if (id >= pool.started) {
+            pthread_mutex_unlock(&pool.lock);
+            return NULL;
+        }
+        seen = pool.generation;
+        // Workers above the current thread count sit this job out
+        bool participate = id < pool.participants;
+        pthread_mutex_unlock(&pool.lock);
+
+        if (!participate)
+            continue;
+
+        runChunks();
+
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.busy == 0)
+            pthread_cond_signal(&pool.done);
+        pthread_mutex_unlock(&pool.lock);
+    }
+    return NULL;
+}
+
+// A forked child (eg. by parallel::mclapply) has no worker threads, and the
+// lock might have been held by one of them
+static void resetInChild() {
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.wake, NULL);
+    pthread_cond_init(&pool.done, NULL);
+    pool.started = 0;
+    pool.generation = 0;
+    pool.busy = 0;
+}
+
+// Starts workers up to the configured count, returns how many are running
+static int startWorkers() {
+    static bool atfork = false;
+    if (!atfork) {
+        pthread_atfork(NULL, NULL, resetInChild);
+        atfork = true;
+    }
+    while (pool.started < pool.threads - 1) {
+        pthread_mutex_lock(&pool.lock);
+        int id = pool.started;
+        int failed = pthread_create(&pool.workers[id], NULL, worker,
+                                    (void*)(intptr_t)id);
+        if (!failed)
+            pool.started++;
+        pthread_mutex_unlock(&pool.lock);
+        if (failed)
+            break;
+    }
+    return pool.started < pool.threads - 1 ? pool.started : pool.threads - 1;
+}
+
+void parallelFor(R_xlen_t n, ParallelChunk chunk, void* data) {
+    if (pool.threads <= 1 || n < PARALLEL_THRESHOLD) {
+        chunk(data, 0, n);
+        return;
+    }
+
+    int workers = startWorkers();
+    if (workers == 0) {
+        chunk(data, 0, n);
+        return;
+    }
+
+    R_xlen_t chunks = (R_xlen_t)(workers + 1) * CHUNKS_PER_THREAD;
+    R_xlen_t chunkSize = (n + chunks - 1) / chunks;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.chunk = chunk;
+    pool.data = data;
+    pool.n = n;
+    pool.chunkSize = chunkSize;
+    pool.chunks = (n + chunkSize - 1) / chunkSize;
+    pool.next = 0;
+    pool.participants = workers;
+    pool.busy = workers;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    runChunks();
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.busy > 0)
+        pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+int setParallelThreads(int threads) {
+    int old = pool.threads;
+    if (threads < 1)
+        threads = 1;
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+    pool.threads = threads;
+
+    // Surplus workers are stopped, they are started again when needed
+    int keep = threads - 1;
+    pthread_mutex_lock(&pool.lock);
+    int started = pool.started;
+    if (started > keep) {
+        pool.started = keep;
+        pthread_cond_broadcast(&pool.wake);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    for (int i = keep; i < started; ++i)
+        pthread_join(pool.workers[i], NULL);
+    return old;
+}
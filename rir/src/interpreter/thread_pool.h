@@ -0,0 +1,32 @@
+#ifndef RIR_INTERPRETER_THREAD_POOL_H
+#define RIR_INTERPRETER_THREAD_POOL_H
+
+#include "../config.h"
+
+/** A pool of worker threads for splitting elementwise vector operations.
+
+  Only the main thread submits work and it takes part in executing it. The
+  chunks must not touch the R API (no allocation, no errors, no warnings),
+  they should only read and write raw REAL() / INTEGER() buffers.
+
+  Workers are started lazily on the first parallel loop, also again in a
+  forked child, and the surplus ones are joined when the thread count goes
+  down. The default is a single thread, ie. everything runs on the main
+  thread.
+ */
+
+/** Vectors shorter than this are not worth the synchronization. */
+#define PARALLEL_THRESHOLD 100000
+
+/** Runs chunk(data, from, to) over [0, n), split across the pool if n is
+ * large enough.
+ */
+typedef void (*ParallelChunk)(void* data, R_xlen_t from, R_xlen_t to);
+C_OR_CPP void parallelFor(R_xlen_t n, ParallelChunk chunk, void* data);
+
+/** Sets the number of threads (including the main thread) used for parallel
+ * loops. Returns the previous setting.
+ */
+C_OR_CPP int setParallelThreads(int threads);
+
+#endif
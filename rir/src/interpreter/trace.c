@@ -0,0 +1,27 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define TRACE_SLOTS 64
+
+// Direct mapped by the address of the function, a function which does not
+// get optimized in time may lose its trace to another one
+static Trace traces[TRACE_SLOTS];
+
+static unsigned slotOf(Function* fun) {
+    return (((uintptr_t)fun >> 4) * 2654435761u) % TRACE_SLOTS;
+}
+
+void Trace_record(Trace* trace) {
+    memcpy(&traces[slotOf(trace->fun)], trace, sizeof(Trace));
+}
+
+bool Trace_take(Function* fun, Trace* out) {
+    Trace* t = &traces[slotOf(fun)];
+    if (t->fun != fun)
+        return false;
+    memcpy(out, t, sizeof(Trace));
+    t->fun = NULL;
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef RIR_INTERPRETER_TRACE_H
+#define RIR_INTERPRETER_TRACE_H
+
+#include "interp_data.h"
+
+/** Traces of hot loops.
+
+  The interpreter records one iteration of a loop which got hot in the body of
+  a function: the back edge which closed it and the direction of every
+  conditional branch on the way. The optimizer then copies the recorded path
+  into a straight superblock (see optimizer/superblock.h).
+
+  The trace only decides the layout, the superblock keeps every branch. A
+  stale trace, eg. of a collected function at the same address, makes for a
+  bad layout, but never for wrong code.
+ */
+
+#define MAX_TRACE_BRANCHES 64
+
+typedef struct {
+    OpcodeT* pc; ///< The branch instruction
+    unsigned taken;
+} TraceBranch;
+
+typedef struct {
+    Function* fun;
+    OpcodeT* backEdge; ///< The branch which closed the iteration
+    unsigned length;
+    TraceBranch branches[MAX_TRACE_BRANCHES];
+} Trace;
+
+/** Stores a copy of the trace for trace->fun, replacing the previous one. */
+C_OR_CPP void Trace_record(Trace* trace);
+
+/** Moves the trace recorded for fun into out. Returns false if there is none.
+ */
+C_OR_CPP bool Trace_take(Function* fun, Trace* out);
+
+#endif
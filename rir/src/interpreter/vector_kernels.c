@@ -0,0 +1,508 @@
+#include <assert.h>
+#include <limits.h>
+
+#include "vector_kernels.h"
+#include "thread_pool.h"
+
+// Expands BODY (using a and b) into three loops, for two vectors and for a
+// recycled scalar on either side. Keeping the scalar out of the indexing lets
+// the compiler vectorize all three.
+#define RECYCLING_LOOP(T1, T2, BODY)                                           \
+    do {                                                                       \
+        if (nx == ny) {                                                        \
+            for (R_xlen_t i = 0; i < n; ++i) {                                 \
+                T1 a = x[i];                                                   \
+                T2 b = y[i];                                                   \
+                BODY;                                                          \
+            }                                                                  \
+        } else if (nx == 1) {                                                  \
+            T1 a = x[0];                                                       \
+            for (R_xlen_t i = 0; i < n; ++i) {                                 \
+                T2 b = y[i];                                                   \
+                BODY;                                                          \
+            }                                                                  \
+        } else {                                                               \
+            T2 b = y[0];                                                       \
+            for (R_xlen_t i = 0; i < n; ++i) {                                 \
+                T1 a = x[i];                                                   \
+                BODY;                                                          \
+            }                                                                  \
+        }                                                                      \
+    } while (0)
+
+RIR_VECTOR_KERNEL
+static void realArith(ArithKernel op, double* res, R_xlen_t n,
+                      const double* x, R_xlen_t nx, const double* y,
+                      R_xlen_t ny) {
+    switch (op) {
+    case KERNEL_ADD:
+        RECYCLING_LOOP(double, double, res[i] = a + b);
+        break;
+    case KERNEL_SUB:
+        RECYCLING_LOOP(double, double, res[i] = a - b);
+        break;
+    case KERNEL_MUL:
+        RECYCLING_LOOP(double, double, res[i] = a * b);
+        break;
+    case KERNEL_DIV:
+        RECYCLING_LOOP(double, double, res[i] = a / b);
+        break;
+    }
+}
+
+// Computes in 64 bit and maps NA operands and results outside of
+// [-INT_MAX, INT_MAX] to NA (INT_MIN), without branches.
+#define INT_ARITH(op)                                                          \
+    RECYCLING_LOOP(int, int, {                                                 \
+        long long r = (long long)a op(long long) b;                            \
+        int na = (a == NA_INTEGER) | (b == NA_INTEGER);                        \
+        int out = (r > INT_MAX) | (r < -INT_MAX);                              \
+        res[i] = (na | out) ? NA_INTEGER : (int)r;                             \
+        overflow |= out & !na;                                                 \
+    })
+
+RIR_VECTOR_KERNEL
+static bool intArith(ArithKernel op, int* res, R_xlen_t n, const int* x,
+                     R_xlen_t nx, const int* y, R_xlen_t ny) {
+    int overflow = 0;
+    switch (op) {
+    case KERNEL_ADD:
+        INT_ARITH(+);
+        break;
+    case KERNEL_SUB:
+        INT_ARITH(-);
+        break;
+    case KERNEL_MUL:
+        INT_ARITH(*);
+        break;
+    case KERNEL_DIV:
+        assert(false);
+        break;
+    }
+    return overflow;
+}
+
+#undef INT_ARITH
+
+RIR_VECTOR_KERNEL
+static void intDiv(double* res, R_xlen_t n, const int* x, R_xlen_t nx,
+                   const int* y, R_xlen_t ny) {
+    RECYCLING_LOOP(int, int, {
+        res[i] = (a == NA_INTEGER || b == NA_INTEGER)
+                     ? NA_REAL
+                     : (double)a / (double)b;
+    });
+}
+
+// NaN compares unequal to itself, and NA (INT_MIN) is the only NA logical
+#define REAL_COMPARE(op)                                                       \
+    RECYCLING_LOOP(double, double, {                                           \
+        res[i] = (a != a || b != b) ? NA_LOGICAL : (a op b);                   \
+    })
+
+RIR_VECTOR_KERNEL
+static void realCompare(CompareKernel op, int* res, R_xlen_t n,
+                        const double* x, R_xlen_t nx, const double* y,
+                        R_xlen_t ny) {
+    switch (op) {
+    case KERNEL_LT:
+        REAL_COMPARE(<);
+        break;
+    case KERNEL_GT:
+        REAL_COMPARE(>);
+        break;
+    case KERNEL_LE:
+        REAL_COMPARE(<=);
+        break;
+    case KERNEL_GE:
+        REAL_COMPARE(>=);
+        break;
+    case KERNEL_EQ:
+        REAL_COMPARE(==);
+        break;
+    case KERNEL_NE:
+        REAL_COMPARE(!=);
+        break;
+    }
+}
+
+#undef REAL_COMPARE
+
+#define INT_COMPARE(op)                                                        \
+    RECYCLING_LOOP(int, int, {                                                 \
+        res[i] = (a == NA_INTEGER || b == NA_INTEGER) ? NA_LOGICAL : (a op b); \
+    })
+
+RIR_VECTOR_KERNEL
+static void intCompare(CompareKernel op, int* res, R_xlen_t n,
+                       const int* x, R_xlen_t nx, const int* y,
+                       R_xlen_t ny) {
+    switch (op) {
+    case KERNEL_LT:
+        INT_COMPARE(<);
+        break;
+    case KERNEL_GT:
+        INT_COMPARE(>);
+        break;
+    case KERNEL_LE:
+        INT_COMPARE(<=);
+        break;
+    case KERNEL_GE:
+        INT_COMPARE(>=);
+        break;
+    case KERNEL_EQ:
+        INT_COMPARE(==);
+        break;
+    case KERNEL_NE:
+        INT_COMPARE(!=);
+        break;
+    }
+}
+
+#undef INT_COMPARE
+#undef RECYCLING_LOOP
+
+RIR_VECTOR_KERNEL
+static bool realMath1(double (*fun)(double), double* res, R_xlen_t n,
+                      const double* x) {
+    int newNaN = 0;
+    for (R_xlen_t i = 0; i < n; ++i) {
+        res[i] = fun(x[i]);
+        newNaN |= (res[i] != res[i]) & (x[i] == x[i]);
+    }
+    return newNaN;
+}
+
+RIR_VECTOR_KERNEL
+static bool intMath1(double (*fun)(double), double* res, R_xlen_t n,
+                     const int* x) {
+    int newNaN = 0;
+    for (R_xlen_t i = 0; i < n; ++i) {
+        int na = x[i] == NA_INTEGER;
+        res[i] = na ? NA_REAL : fun((double)x[i]);
+        newNaN |= (res[i] != res[i]) & !na;
+    }
+    return newNaN;
+}
+
+// The public entry points split the work with parallelFor. A chunk gets the
+// matching slices of the result and the operands, a recycled scalar stays a
+// scalar.
+
+typedef struct {
+    int op;
+    double (*fun)(double);
+    void* res;
+    const void* x;
+    R_xlen_t nx;
+    const void* y;
+    R_xlen_t ny;
+    int flag; // or of the chunk results
+} KernelCall;
+
+#define CHUNK(TRES, TX, TY)                                                    \
+    KernelCall* k = (KernelCall*)data;                                         \
+    R_xlen_t n = to - from;                                                    \
+    TRES* res = (TRES*)k->res + from;                                          \
+    const TX* x = (const TX*)k->x + (k->nx == 1 ? 0 : from);                   \
+    R_xlen_t nx = k->nx == 1 ? 1 : n;                                          \
+    const TY* y = (const TY*)k->y + (k->ny == 1 ? 0 : from);                   \
+    R_xlen_t ny = k->ny == 1 ? 1 : n
+
+#define SET_FLAG(f)                                                            \
+    if (f)                                                                     \
+    __atomic_or_fetch(&k->flag, 1, __ATOMIC_RELAXED)
+
+static void realArithChunk(void* data, R_xlen_t from, R_xlen_t to) {
+    CHUNK(double, double, double);
+    realArith(k->op, res, n, x, nx, y, ny);
+}
+
+static void intArithChunk(void* data, R_xlen_t from, R_xlen_t to) {
+    CHUNK(int, int, int);
+    SET_FLAG(intArith(k->op, res, n, x, nx, y, ny));
+}
+
+static void intDivChunk(void* data, R_xlen_t from, R_xlen_t to) {
+    CHUNK(double, int, int);
+    intDiv(res, n, x, nx, y, ny);
+}
+
+static void realCompareChunk(void* data, R_xlen_t from, R_xlen_t to) {
+    CHUNK(int, double, double);
+    realCompare(k->op, res, n, x, nx, y, ny);
+}
+
+static void intCompareChunk(void* data, R_xlen_t from, R_xlen_t to) {
+    CHUNK(int, int, int);
+    intCompare(k->op, res, n, x, nx, y, ny);
+}
+
+static void realMath1Chunk(void* data, R_xlen_t from, R_xlen_t to) {
+    KernelCall* k = (KernelCall*)data;
+    SET_FLAG(realMath1(k->fun, (double*)k->res + from, to - from,
+                       (const double*)k->x + from));
+}
+
+static void intMath1Chunk(void* data, R_xlen_t from, R_xlen_t to) {
+    KernelCall* k = (KernelCall*)data;
+    SET_FLAG(intMath1(k->fun, (double*)k->res + from, to - from,
+                      (const int*)k->x + from));
+}
+
+#undef SET_FLAG
+#undef CHUNK
+
+// Elements per block of a fused expression, the temporaries of a block stay
+// in the L1 cache.
+#define FUSED_BLOCK 256
+
+typedef struct {
+    const int* program;
+    int length;
+    const FusedLeaf* leaves;
+    double* res;
+} FusedCall;
+
+// Computes the n <= FUSED_BLOCK elements of the program from start into res.
+// Every stack slot owns a block sized buffer, an operation writes into the
+// slot of its left operand. The last operation writes straight into res.
+static void fusedBlock(const int* program, int length, const FusedLeaf* leaves,
+                       R_xlen_t start, R_xlen_t n, double* res) {
+    double buffer[MAX_FUSED_LEAVES][FUSED_BLOCK];
+    double scalar[MAX_FUSED_LEAVES];
+    const double* stack[MAX_FUSED_LEAVES];
+    int isVector[MAX_FUSED_LEAVES];
+
+    int sp = 0;
+    for (int pc = 0; pc < length; ++pc) {
+        int entry = program[pc];
+        if (entry >= 0) {
+            const FusedLeaf* leaf = &leaves[entry];
+            isVector[sp] = leaf->data != NULL;
+            stack[sp] = leaf->data ? leaf->data + start : &leaf->value;
+            ++sp;
+            continue;
+        }
+
+        --sp;
+        int vector = isVector[sp - 1] | isVector[sp];
+        R_xlen_t nres = vector ? n : 1;
+        double* out;
+        if (pc == length - 1 && vector)
+            out = res;
+        else
+            out = vector ? buffer[sp - 1] : &scalar[sp - 1];
+        realArith(FUSED_KERNEL(entry), out, nres, stack[sp - 1],
+                  isVector[sp - 1] ? nres : 1, stack[sp],
+                  isVector[sp] ? nres : 1);
+        stack[sp - 1] = out;
+        isVector[sp - 1] = vector;
+    }
+    assert(sp == 1);
+
+    // only scalar leaves, the result is recycled
+    if (!isVector[0])
+        for (R_xlen_t i = 0; i < n; ++i)
+            res[i] = *stack[0];
+}
+
+static void fusedArithChunk(void* data, R_xlen_t from, R_xlen_t to) {
+    FusedCall* k = (FusedCall*)data;
+    for (R_xlen_t start = from; start < to; start += FUSED_BLOCK) {
+        R_xlen_t n = to - start < FUSED_BLOCK ? to - start : FUSED_BLOCK;
+        fusedBlock(k->program, k->length, k->leaves, start, n,
+                   k->res + start);
+    }
+}
+
+void fusedReduceKernel(const int* program, int length,
+                       const FusedLeaf* leaves, R_xlen_t n,
+                       FusedReduction reduce, void* data) {
+    double block[FUSED_BLOCK];
+    for (R_xlen_t start = 0; start < n; start += FUSED_BLOCK) {
+        R_xlen_t len = n - start < FUSED_BLOCK ? n - start : FUSED_BLOCK;
+        fusedBlock(program, length, leaves, start, len, block);
+        reduce(data, block, len);
+    }
+}
+
+#undef FUSED_BLOCK
+
+void realArithKernel(ArithKernel op, double* res, R_xlen_t n,
+                     const double* x, R_xlen_t nx, const double* y,
+                     R_xlen_t ny) {
+    KernelCall k = {op, NULL, res, x, nx, y, ny, 0};
+    parallelFor(n, realArithChunk, &k);
+}
+
+bool intArithKernel(ArithKernel op, int* res, R_xlen_t n, const int* x,
+                    R_xlen_t nx, const int* y, R_xlen_t ny) {
+    KernelCall k = {op, NULL, res, x, nx, y, ny, 0};
+    parallelFor(n, intArithChunk, &k);
+    return k.flag;
+}
+
+void intDivKernel(double* res, R_xlen_t n, const int* x, R_xlen_t nx,
+                  const int* y, R_xlen_t ny) {
+    KernelCall k = {KERNEL_DIV, NULL, res, x, nx, y, ny, 0};
+    parallelFor(n, intDivChunk, &k);
+}
+
+void realCompareKernel(CompareKernel op, int* res, R_xlen_t n,
+                       const double* x, R_xlen_t nx, const double* y,
+                       R_xlen_t ny) {
+    KernelCall k = {op, NULL, res, x, nx, y, ny, 0};
+    parallelFor(n, realCompareChunk, &k);
+}
+
+void intCompareKernel(CompareKernel op, int* res, R_xlen_t n, const int* x,
+                      R_xlen_t nx, const int* y, R_xlen_t ny) {
+    KernelCall k = {op, NULL, res, x, nx, y, ny, 0};
+    parallelFor(n, intCompareChunk, &k);
+}
+
+void fusedArithKernel(const int* program, int length,
+                      const FusedLeaf* leaves, double* res, R_xlen_t n) {
+    FusedCall k = {program, length, leaves, res};
+    parallelFor(n, fusedArithChunk, &k);
+}
+
+bool realMath1Kernel(double (*fun)(double), double* res, R_xlen_t n,
+                     const double* x) {
+    KernelCall k = {0, fun, res, x, n, NULL, 0, 0};
+    parallelFor(n, realMath1Chunk, &k);
+    return k.flag;
+}
+
+bool intMath1Kernel(double (*fun)(double), double* res, R_xlen_t n,
+                    const int* x) {
+    KernelCall k = {0, fun, res, x, n, NULL, 0, 0};
+    parallelFor(n, intMath1Chunk, &k);
+    return k.flag;
+}
+
+// Reductions. Sums and products have to be sequential to give the same
+// rounding as GNU-R, the others are free to vectorize.
+
+void realSumKernel(long double* acc, const double* x, R_xlen_t n) {
+    long double s = *acc;
+    for (R_xlen_t i = 0; i < n; ++i)
+        s += x[i];
+    *acc = s;
+}
+
+void realProdKernel(long double* acc, const double* x, R_xlen_t n) {
+    long double s = *acc;
+    for (R_xlen_t i = 0; i < n; ++i)
+        s *= x[i];
+    *acc = s;
+}
+
+void realDeviationKernel(long double* acc, long double mean, const double* x,
+                         R_xlen_t n) {
+    long double s = *acc;
+    for (R_xlen_t i = 0; i < n; ++i)
+        s += x[i] - mean;
+    *acc = s;
+}
+
+RIR_VECTOR_KERNEL
+bool realMinKernel(double* res, const double* x, R_xlen_t n) {
+    double m = *res;
+    int nan = 0;
+    for (R_xlen_t i = 0; i < n; ++i) {
+        m = x[i] < m ? x[i] : m;
+        nan |= x[i] != x[i];
+    }
+    *res = m;
+    return nan;
+}
+
+RIR_VECTOR_KERNEL
+bool realMaxKernel(double* res, const double* x, R_xlen_t n) {
+    double m = *res;
+    int nan = 0;
+    for (R_xlen_t i = 0; i < n; ++i) {
+        m = x[i] > m ? x[i] : m;
+        nan |= x[i] != x[i];
+    }
+    *res = m;
+    return nan;
+}
+
+// R_IsNA without the R API: NA is the NaN with 1954 in its low word
+bool realHasNAKernel(const double* x, R_xlen_t n) {
+#ifdef WORDS_BIGENDIAN
+    const int lw = 1;
+#else
+    const int lw = 0;
+#endif
+    for (R_xlen_t i = 0; i < n; ++i) {
+        union {
+            double d;
+            unsigned int w[2];
+        } v;
+        v.d = x[i];
+        if (x[i] != x[i] && v.w[lw] == 1954)
+            return true;
+    }
+    return false;
+}
+
+RIR_VECTOR_KERNEL
+bool intSumKernel(long long* res, const int* x, R_xlen_t n) {
+    long long s = *res;
+    int na = 0;
+    for (R_xlen_t i = 0; i < n; ++i) {
+        s += x[i];
+        na |= x[i] == NA_INTEGER;
+    }
+    *res = s;
+    return na;
+}
+
+bool intProdKernel(long double* acc, const int* x, R_xlen_t n) {
+    long double s = *acc;
+    for (R_xlen_t i = 0; i < n; ++i) {
+        if (x[i] == NA_INTEGER)
+            return true;
+        s *= x[i];
+    }
+    *acc = s;
+    return false;
+}
+
+// NA is INT_MIN, it always wins the minimum
+RIR_VECTOR_KERNEL
+bool intMinKernel(int* res, const int* x, R_xlen_t n) {
+    int m = *res;
+    for (R_xlen_t i = 0; i < n; ++i)
+        m = x[i] < m ? x[i] : m;
+    *res = m;
+    return m == NA_INTEGER;
+}
+
+RIR_VECTOR_KERNEL
+bool intMaxKernel(int* res, const int* x, R_xlen_t n) {
+    int m = *res;
+    int na = 0;
+    for (R_xlen_t i = 0; i < n; ++i) {
+        m = x[i] > m ? x[i] : m;
+        na |= x[i] == NA_INTEGER;
+    }
+    *res = m;
+    return na;
+}
+
+RIR_VECTOR_KERNEL
+void lglCountKernel(R_xlen_t* nTrue, R_xlen_t* nNA, const int* x,
+                    R_xlen_t n) {
+    R_xlen_t t = 0, na = 0;
+    for (R_xlen_t i = 0; i < n; ++i) {
+        na += x[i] == NA_LOGICAL;
+        t += x[i] != 0 && x[i] != NA_LOGICAL;
+    }
+    *nTrue = t;
+    *nNA = na;
+}
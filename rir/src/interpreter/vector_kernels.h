@@ -0,0 +1,129 @@
+#ifndef RIR_INTERPRETER_VECTOR_KERNELS_H
+#define RIR_INTERPRETER_VECTOR_KERNELS_H
+
+#include "../config.h"
+
+/** Elementwise kernels for the arithmetic and relational instructions.
+
+  They work on plain arrays, one of the operands may have length one and is
+  then recycled. The caller is responsible for everything R specific, ie.
+  attributes, coercion and warnings. Long vectors are split across the
+  thread pool (see thread_pool.h).
+
+  Each kernel is compiled for AVX2 and for the x86_64 baseline (SSE2), the
+  loader picks the best version for the running CPU. Other platforms get a
+  single portable version.
+ */
+
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) &&       \
+    defined(__linux__)
+// The default build is -O2, which does not (fully) enable the vectorizer
+#define RIR_VECTOR_KERNEL                                                      \
+    __attribute__((target_clones("avx2", "default"),                           \
+                   optimize("tree-vectorize")))
+#else
+#define RIR_VECTOR_KERNEL
+#endif
+
+typedef enum { KERNEL_ADD, KERNEL_SUB, KERNEL_MUL, KERNEL_DIV } ArithKernel;
+
+typedef enum {
+    KERNEL_LT,
+    KERNEL_GT,
+    KERNEL_LE,
+    KERNEL_GE,
+    KERNEL_EQ,
+    KERNEL_NE
+} CompareKernel;
+
+C_OR_CPP void realArithKernel(ArithKernel op, double* res, R_xlen_t n,
+                              const double* x, R_xlen_t nx, const double* y,
+                              R_xlen_t ny);
+
+/** Integer +, - and *, NA on overflow. Returns whether any overflow happened.
+ */
+C_OR_CPP bool intArithKernel(ArithKernel op, int* res, R_xlen_t n,
+                             const int* x, R_xlen_t nx, const int* y,
+                             R_xlen_t ny);
+
+/** Integer division, which yields doubles. */
+C_OR_CPP void intDivKernel(double* res, R_xlen_t n, const int* x,
+                           R_xlen_t nx, const int* y, R_xlen_t ny);
+
+C_OR_CPP void realCompareKernel(CompareKernel op, int* res, R_xlen_t n,
+                                const double* x, R_xlen_t nx,
+                                const double* y, R_xlen_t ny);
+
+C_OR_CPP void intCompareKernel(CompareKernel op, int* res, R_xlen_t n,
+                               const int* x, R_xlen_t nx, const int* y,
+                               R_xlen_t ny);
+
+/** Applies fun to every element, NA integers become NA_REAL. Returns whether
+ * some result is NaN for a non NaN input.
+ */
+C_OR_CPP bool realMath1Kernel(double (*fun)(double), double* res, R_xlen_t n,
+                              const double* x);
+C_OR_CPP bool intMath1Kernel(double (*fun)(double), double* res, R_xlen_t n,
+                             const int* x);
+
+/** Fused arithmetic expressions (see optimizer/fusion.h).
+
+  A program is in reverse polish notation: a non-negative entry pushes the
+  leaf with that index, a negative one pops two operands and pushes the
+  result of the kernel FUSED_KERNEL(entry). The whole expression is computed
+  block by block, intermediate values never leave the cache.
+ */
+#define MAX_FUSED_LEAVES 16
+#define FUSED_OP(kernel) (-(int)(kernel)-1)
+#define FUSED_KERNEL(entry) ((ArithKernel)(-(entry)-1))
+
+/** A leaf is a vector of the result length or, if data is NULL, a scalar. */
+typedef struct {
+    const double* data;
+    double value;
+} FusedLeaf;
+
+C_OR_CPP void fusedArithKernel(const int* program, int length,
+                               const FusedLeaf* leaves, double* res,
+                               R_xlen_t n);
+
+/** Evaluates a fused program like fusedArithKernel, but passes the values
+ * block by block, in order, to reduce instead of storing them.
+ */
+typedef void (*FusedReduction)(void* data, const double* x, R_xlen_t n);
+C_OR_CPP void fusedReduceKernel(const int* program, int length,
+                                const FusedLeaf* leaves, R_xlen_t n,
+                                FusedReduction reduce, void* data);
+
+/** Reductions. The ones on doubles can be fed a long vector block by block,
+ * sums and products accumulate sequentially in long double like GNU-R does.
+ */
+C_OR_CPP void realSumKernel(long double* acc, const double* x, R_xlen_t n);
+C_OR_CPP void realProdKernel(long double* acc, const double* x, R_xlen_t n);
+
+/** Sum of the deviations from mean, the second pass of mean() */
+C_OR_CPP void realDeviationKernel(long double* acc, long double mean,
+                                  const double* x, R_xlen_t n);
+
+/** Updates the minimum (maximum) in res. Returns whether x contains NaN or
+ * NA, then res is meaningless.
+ */
+C_OR_CPP bool realMinKernel(double* res, const double* x, R_xlen_t n);
+C_OR_CPP bool realMaxKernel(double* res, const double* x, R_xlen_t n);
+
+/** Whether x contains NA, as opposed to just NaN. */
+C_OR_CPP bool realHasNAKernel(const double* x, R_xlen_t n);
+
+/** Integer reductions, they return whether x contains NA. The sum is exact
+ * in 64 bit.
+ */
+C_OR_CPP bool intSumKernel(long long* res, const int* x, R_xlen_t n);
+C_OR_CPP bool intProdKernel(long double* acc, const int* x, R_xlen_t n);
+C_OR_CPP bool intMinKernel(int* res, const int* x, R_xlen_t n);
+C_OR_CPP bool intMaxKernel(int* res, const int* x, R_xlen_t n);
+
+/** Counts the TRUE and NA elements of a logical vector. */
+C_OR_CPP void lglCountKernel(R_xlen_t* nTrue, R_xlen_t* nNA, const int* x,
+                             R_xlen_t n);
+
+#endif
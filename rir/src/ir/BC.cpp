@@ -19,31 +19,55 @@ bool BC::operator==(const BC& other) const {
 
     switch (bc) {
     case BC_t::push_:
+    case BC_t::lazy_:
     case BC_t::ldfun_:
     case BC_t::ldddvar_:
     case BC_t::ldarg_:
     case BC_t::ldvar_:
     case BC_t::ldlval_:
     case BC_t::stvar_:
+    case BC_t::unbind_:
     case BC_t::missing_:
     case BC_t::subassign2_:
+    case BC_t::subassign_mat_:
+    case BC_t::subassign2_mat_:
         return immediate.pool == other.immediate.pool;
 
     case BC_t::dispatch_:
     case BC_t::call_:
+    case BC_t::call_pic_:
     case BC_t::call_stack_:
     case BC_t::static_call_stack_:
     case BC_t::dispatch_stack_:
+    case BC_t::std_generic_:
         return immediate.call_args.call_id == other.immediate.call_args.call_id;
 
     case BC_t::guard_env_:
         return immediate.guard_id == other.immediate.guard_id;
 
+    case BC_t::dollar_:
+    case BC_t::extract_name_:
+        return immediate.name_cache.name == other.immediate.name_cache.name &&
+               immediate.name_cache.cache == other.immediate.name_cache.cache;
+
+    case BC_t::subassign_dollar_:
+    case BC_t::subassign2_name_:
+        return immediate.assign_name.target ==
+                   other.immediate.assign_name.target &&
+               immediate.assign_name.name == other.immediate.assign_name.name &&
+               immediate.assign_name.cache == other.immediate.assign_name.cache;
+
+    case BC_t::fused_arith_:
+        return immediate.fused_arith.program ==
+                   other.immediate.fused_arith.program &&
+               immediate.fused_arith.nargs == other.immediate.fused_arith.nargs;
+
     case BC_t::guard_fun_:
         return immediate.guard_fun_args.name ==
                    other.immediate.guard_fun_args.name &&
                immediate.guard_fun_args.expected ==
-                   other.immediate.guard_fun_args.expected;
+                   other.immediate.guard_fun_args.expected &&
+               immediate.guard_fun_args.id == other.immediate.guard_fun_args.id;
 
     case BC_t::promise_:
     case BC_t::push_code_:
@@ -62,6 +86,8 @@ bool BC::operator==(const BC& other) const {
     case BC_t::is_:
     case BC_t::put_:
     case BC_t::alloc_:
+    case BC_t::math1_:
+    case BC_t::reduce_:
         return immediate.i == other.immediate.i;
 
     case BC_t::subset2_:
@@ -72,6 +98,8 @@ bool BC::operator==(const BC& other) const {
     case BC_t::length_:
     case BC_t::names_:
     case BC_t::set_names_:
+    case BC_t::alloc_as_:
+    case BC_t::set_elt_:
     case BC_t::force_:
     case BC_t::pop_:
     case BC_t::close_:
@@ -95,6 +123,17 @@ bool BC::operator==(const BC& other) const {
     case BC_t::pow_:
     case BC_t::sub_:
     case BC_t::lt_:
+    case BC_t::gt_:
+    case BC_t::le_:
+    case BC_t::ge_:
+    case BC_t::eq_:
+    case BC_t::ne_:
+    case BC_t::uminus_:
+    case BC_t::not_:
+    case BC_t::and_:
+    case BC_t::or_:
+    case BC_t::abs_:
+    case BC_t::modulus_:
     case BC_t::seq_:
     case BC_t::return_:
     case BC_t::isfun_:
@@ -104,6 +143,8 @@ bool BC::operator==(const BC& other) const {
     case BC_t::subassign_:
         return true;
 
+    // quickened instructions are decoded as the generic ones
+    case BC_t::extract1_real_:
     case BC_t::invalid_:
     case BC_t::num_of:
         break;
@@ -117,14 +158,18 @@ void BC::write(CodeStream& cs) const {
     cs.insert(bc);
     switch (bc) {
     case BC_t::push_:
+    case BC_t::lazy_:
     case BC_t::ldarg_:
     case BC_t::ldfun_:
     case BC_t::ldddvar_:
     case BC_t::ldvar_:
     case BC_t::ldlval_:
     case BC_t::stvar_:
+    case BC_t::unbind_:
     case BC_t::missing_:
     case BC_t::subassign2_:
+    case BC_t::subassign_mat_:
+    case BC_t::subassign2_mat_:
         cs.insert(immediate.pool);
         return;
 
@@ -136,12 +181,28 @@ void BC::write(CodeStream& cs) const {
         cs.insert(immediate.guard_fun_args);
         return;
 
+    case BC_t::fused_arith_:
+        cs.insert(immediate.fused_arith);
+        return;
+
+    case BC_t::dollar_:
+    case BC_t::extract_name_:
+        cs.insert(immediate.name_cache);
+        return;
+
+    case BC_t::subassign_dollar_:
+    case BC_t::subassign2_name_:
+        cs.insert(immediate.assign_name);
+        return;
+
     // They have to be inserted by CodeStream::insertCall
     case BC_t::call_:
+    case BC_t::call_pic_:
     case BC_t::dispatch_:
     case BC_t::call_stack_:
     case BC_t::static_call_stack_:
     case BC_t::dispatch_stack_:
+    case BC_t::std_generic_:
         assert(false);
         break;
 
@@ -163,6 +224,8 @@ void BC::write(CodeStream& cs) const {
     case BC_t::is_:
     case BC_t::put_:
     case BC_t::alloc_:
+    case BC_t::math1_:
+    case BC_t::reduce_:
         cs.insert(immediate.i);
         return;
 
@@ -174,6 +237,8 @@ void BC::write(CodeStream& cs) const {
     case BC_t::length_:
     case BC_t::names_:
     case BC_t::set_names_:
+    case BC_t::alloc_as_:
+    case BC_t::set_elt_:
     case BC_t::force_:
     case BC_t::pop_:
     case BC_t::close_:
@@ -197,6 +262,17 @@ void BC::write(CodeStream& cs) const {
     case BC_t::pow_:
     case BC_t::sub_:
     case BC_t::lt_:
+    case BC_t::gt_:
+    case BC_t::le_:
+    case BC_t::ge_:
+    case BC_t::eq_:
+    case BC_t::ne_:
+    case BC_t::uminus_:
+    case BC_t::not_:
+    case BC_t::and_:
+    case BC_t::or_:
+    case BC_t::abs_:
+    case BC_t::modulus_:
     case BC_t::seq_:
     case BC_t::return_:
     case BC_t::isfun_:
@@ -206,6 +282,8 @@ void BC::write(CodeStream& cs) const {
     case BC_t::subassign_:
         return;
 
+    // quickened instructions are decoded as the generic ones
+    case BC_t::extract1_real_:
     case BC_t::invalid_:
     case BC_t::num_of:
     case BC_t::label:
@@ -275,11 +353,14 @@ void BC::print(CallSite cs) {
     }
 
     switch (bc) {
+    // quickened instructions are decoded as the generic ones
+    case BC_t::extract1_real_:
     case BC_t::invalid_:
     case BC_t::num_of:
         assert(false);
         break;
-    case BC_t::dispatch_: {
+    case BC_t::dispatch_:
+    case BC_t::std_generic_: {
         if (cs.isValid()) {
             SEXP selector = cs.selector();
             Rprintf(" `%s` ", CHAR(PRINTNAME(selector)));
@@ -289,7 +370,8 @@ void BC::print(CallSite cs) {
         }
         break;
     }
-    case BC_t::call_: {
+    case BC_t::call_:
+    case BC_t::call_pic_: {
         if (cs.isValid()) {
             printArgs(cs);
             printNames(cs);
@@ -336,21 +418,47 @@ void BC::print(CallSite cs) {
         Rprintf(" %u # ", immediate.pool);
         Rf_PrintValue(immediateConst());
         return;
+    case BC_t::lazy_:
+        Rprintf(" %u # ", immediate.pool);
+        Rf_PrintValue(VECTOR_ELT(immediateConst(), 0));
+        return;
     case BC_t::ldarg_:
     case BC_t::ldfun_:
     case BC_t::ldvar_:
     case BC_t::ldlval_:
     case BC_t::ldddvar_:
     case BC_t::stvar_:
+    case BC_t::unbind_:
     case BC_t::missing_:
         Rprintf(" %u # %s", immediate.pool, CHAR(PRINTNAME((immediateConst()))));
         break;
+    case BC_t::fused_arith_: {
+        // the call of the outermost operation is the last one
+        SEXP calls = VECTOR_ELT(Pool::get(immediate.fused_arith.program), 1);
+        Rprintf(" %u # ", immediate.fused_arith.nargs);
+        Rf_PrintValue(VECTOR_ELT(calls, XLENGTH(calls) - 1));
+        return;
+    }
     case BC_t::guard_fun_: {
         SEXP name = Pool::get(immediate.guard_fun_args.name);
         Rprintf(" %s == %p", CHAR(PRINTNAME(name)),
                 Pool::get(immediate.guard_fun_args.expected));
+        if (immediate.guard_fun_args.id != NO_DEOPT_INFO) {
+            Rprintf(" ");
+            Deoptimizer_print(immediate.guard_fun_args.id);
+        }
         break;
     }
+    case BC_t::dollar_:
+    case BC_t::extract_name_:
+        Rprintf(" %s", CHAR(PRINTNAME(Pool::get(immediate.name_cache.name))));
+        break;
+    case BC_t::subassign_dollar_:
+    case BC_t::subassign2_name_:
+        Rprintf(" %s %s",
+                CHAR(PRINTNAME(Pool::get(immediate.assign_name.target))),
+                CHAR(PRINTNAME(Pool::get(immediate.assign_name.name))));
+        break;
     case BC_t::pick_:
     case BC_t::pull_:
     case BC_t::put_:
@@ -360,6 +468,24 @@ void BC::print(CallSite cs) {
     case BC_t::alloc_:
         Rprintf(" %s", type2char(immediate.i));
         break;
+    case BC_t::math1_: {
+        static const char* names[] = {
+#define V(name, cfun) #name,
+            MATH1_FUNCTIONS(V)
+#undef V
+        };
+        Rprintf(" %s", names[immediate.i]);
+        break;
+    }
+    case BC_t::reduce_: {
+        static const char* names[] = {
+#define V(name) #name,
+            REDUCTIONS(V)
+#undef V
+        };
+        Rprintf(" %s", names[immediate.i]);
+        break;
+    }
     case BC_t::guard_env_:
         Deoptimizer_print(immediate.guard_id);
         Rprintf("\n");
@@ -385,6 +511,17 @@ void BC::print(CallSite cs) {
     case BC_t::pow_:
     case BC_t::sub_:
     case BC_t::lt_:
+    case BC_t::gt_:
+    case BC_t::le_:
+    case BC_t::ge_:
+    case BC_t::eq_:
+    case BC_t::ne_:
+    case BC_t::uminus_:
+    case BC_t::not_:
+    case BC_t::and_:
+    case BC_t::or_:
+    case BC_t::abs_:
+    case BC_t::modulus_:
     case BC_t::return_:
     case BC_t::isfun_:
     case BC_t::invisible_:
@@ -397,12 +534,16 @@ void BC::print(CallSite cs) {
     case BC_t::length_:
     case BC_t::names_:
     case BC_t::set_names_:
+    case BC_t::alloc_as_:
+    case BC_t::set_elt_:
     case BC_t::endcontext_:
     case BC_t::aslogical_:
     case BC_t::lgl_or_:
     case BC_t::lgl_and_:
     case BC_t::subassign_:
     case BC_t::subassign2_:
+    case BC_t::subassign_mat_:
+    case BC_t::subassign2_mat_:
         break;
     case BC_t::promise_:
     case BC_t::push_code_:
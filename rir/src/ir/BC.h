@@ -22,19 +22,25 @@ BC::immediate_t decodeImmediate(BC_t bc, BC_t* pc) {
     BC::immediate_t immediate = {{0}};
     switch (bc) {
     case BC_t::push_:
+    case BC_t::lazy_:
     case BC_t::ldfun_:
     case BC_t::ldarg_:
     case BC_t::ldvar_:
     case BC_t::ldlval_:
     case BC_t::ldddvar_:
     case BC_t::stvar_:
+    case BC_t::unbind_:
     case BC_t::missing_:
     case BC_t::subassign2_:
+    case BC_t::subassign_mat_:
+    case BC_t::subassign2_mat_:
         immediate.pool = *(pool_idx_t*)pc;
         break;
     case BC_t::dispatch_stack_:
     case BC_t::call_:
+    case BC_t::call_pic_:
     case BC_t::dispatch_:
+    case BC_t::std_generic_:
     case BC_t::call_stack_:
     case BC_t::static_call_stack_:
         immediate.call_args = *(CallArgs*)pc;
@@ -45,6 +51,17 @@ BC::immediate_t decodeImmediate(BC_t bc, BC_t* pc) {
     case BC_t::guard_fun_:
         immediate.guard_fun_args = *(GuardFunArgs*)pc;
         break;
+    case BC_t::fused_arith_:
+        immediate.fused_arith = *(FusedArithArgs*)pc;
+        break;
+    case BC_t::dollar_:
+    case BC_t::extract_name_:
+        immediate.name_cache = *(NameCacheArgs*)pc;
+        break;
+    case BC_t::subassign_dollar_:
+    case BC_t::subassign2_name_:
+        immediate.assign_name = *(AssignNameArgs*)pc;
+        break;
     case BC_t::promise_:
     case BC_t::push_code_:
         immediate.fun = *(fun_idx_t*)pc;
@@ -62,6 +79,8 @@ BC::immediate_t decodeImmediate(BC_t bc, BC_t* pc) {
     case BC_t::is_:
     case BC_t::put_:
     case BC_t::alloc_:
+    case BC_t::math1_:
+    case BC_t::reduce_:
         immediate.i = *(uint32_t*)pc;
         break;
     case BC_t::test_bounds_:
@@ -93,6 +112,17 @@ BC::immediate_t decodeImmediate(BC_t bc, BC_t* pc) {
     case BC_t::seq_:
     case BC_t::sub_:
     case BC_t::lt_:
+    case BC_t::gt_:
+    case BC_t::le_:
+    case BC_t::ge_:
+    case BC_t::eq_:
+    case BC_t::ne_:
+    case BC_t::uminus_:
+    case BC_t::not_:
+    case BC_t::and_:
+    case BC_t::or_:
+    case BC_t::abs_:
+    case BC_t::modulus_:
     case BC_t::return_:
     case BC_t::isfun_:
     case BC_t::invisible_:
@@ -102,7 +132,11 @@ BC::immediate_t decodeImmediate(BC_t bc, BC_t* pc) {
     case BC_t::length_:
     case BC_t::names_:
     case BC_t::set_names_:
+    case BC_t::alloc_as_:
+    case BC_t::set_elt_:
         break;
+    // quickened instructions are decoded as the generic ones
+    case BC_t::extract1_real_:
     case BC_t::invalid_:
     case BC_t::num_of:
         assert(false);
@@ -110,17 +144,27 @@ BC::immediate_t decodeImmediate(BC_t bc, BC_t* pc) {
     }
     return immediate;
 }
+
+// The generic instruction of a quickened one
+BC_t dequicken(BC_t bc) {
+    switch (bc) {
+    case BC_t::extract1_real_:
+        return BC_t::extract1_;
+    default:
+        return bc;
+    }
+}
 }
 
 BC BC::advance(BC_t** pc) {
-    BC_t bc = **pc;
+    BC_t bc = dequicken(**pc);
     BC cur(bc, decodeImmediate(bc, (*pc) + 1));
     *pc = (BC_t*)((uintptr_t)(*pc) + cur.size());
     return cur;
 }
 
 BC BC::decode(BC_t* pc) {
-    BC_t bc = *pc;
+    BC_t bc = dequicken(*pc);
     BC cur(bc, decodeImmediate(bc, pc + 1));
     return cur;
 }
@@ -139,6 +183,16 @@ BC BC::push(SEXP constant) {
     i.pool = Pool::insert(constant);
     return BC(BC_t::push_, i);
 }
+// The code is compiled by the interpreter, when the promise is forced
+BC BC::lazy(SEXP ast) {
+    Protect p;
+    SEXP stub = p(Rf_allocVector(VECSXP, 2));
+    SET_VECTOR_ELT(stub, 0, ast);
+    SET_VECTOR_ELT(stub, 1, R_NilValue);
+    immediate_t i;
+    i.pool = Pool::insert(stub);
+    return BC(BC_t::lazy_, i);
+}
 BC BC::push(double constant) {
     immediate_t i;
     i.pool = Pool::getNum(constant);
@@ -186,10 +240,21 @@ BC BC::guardEnv(uint32_t id) {
     i.guard_id = id;
     return BC(BC_t::guard_env_, i);
 }
-BC BC::guardName(SEXP sym, SEXP expected) {
+// The call sites of these two have to be provided separately, see
+// CodeEditor::Cursor::insertCall
+BC BC::staticCallStack(uint32_t nargs) {
+    immediate_t i;
+    i.call_args = {0, nargs};
+    return BC(BC_t::static_call_stack_, i);
+}
+BC BC::callPic(uint32_t nargs) {
     immediate_t i;
-    i.guard_fun_args = {Pool::insert(sym), Pool::insert(expected),
-                        NO_DEOPT_INFO};
+    i.call_args = {0, nargs};
+    return BC(BC_t::call_pic_, i);
+}
+BC BC::guardName(SEXP sym, SEXP expected, uint32_t deoptId) {
+    immediate_t i;
+    i.guard_fun_args = {Pool::insert(sym), Pool::insert(expected), deoptId};
     return BC(BC_t::guard_fun_, i);
 }
 BC BC::guardNamePrimitive(SEXP sym) {
@@ -225,6 +290,12 @@ BC BC::stvar(SEXP sym) {
     i.pool = Pool::insert(sym);
     return BC(BC_t::stvar_, i);
 }
+BC BC::unbind(SEXP sym) {
+    assert(TYPEOF(sym) == SYMSXP);
+    immediate_t i;
+    i.pool = Pool::insert(sym);
+    return BC(BC_t::unbind_, i);
+}
 BC BC::subassign() { return BC(BC_t::subassign_); }
 BC BC::subassign2(SEXP sym) {
     assert(sym == R_NilValue ||
@@ -233,6 +304,56 @@ BC BC::subassign2(SEXP sym) {
     i.pool = Pool::insert(sym);
     return BC(BC_t::subassign2_, i);
 }
+BC BC::subassignMat(SEXP sym) {
+    assert(sym == R_NilValue ||
+           (TYPEOF(sym) == SYMSXP && strlen(CHAR(PRINTNAME(sym)))));
+    immediate_t i;
+    i.pool = Pool::insert(sym);
+    return BC(BC_t::subassign_mat_, i);
+}
+BC BC::subassign2Mat(SEXP sym) {
+    assert(sym == R_NilValue ||
+           (TYPEOF(sym) == SYMSXP && strlen(CHAR(PRINTNAME(sym)))));
+    immediate_t i;
+    i.pool = Pool::insert(sym);
+    return BC(BC_t::subassign2_mat_, i);
+}
+// Per site cache of a name lookup: the names vector the position was computed
+// for and the position. See cachedNamePosition in interp.c
+static pool_idx_t newNameCache() {
+    Protect p;
+    SEXP cache;
+    p(cache = Rf_allocVector(VECSXP, 2));
+    SET_VECTOR_ELT(cache, 0, R_NilValue);
+    SET_VECTOR_ELT(cache, 1, Rf_ScalarInteger(0));
+    return Pool::insert(cache);
+}
+BC BC::dollar(SEXP name) {
+    assert(TYPEOF(name) == SYMSXP);
+    immediate_t i;
+    i.name_cache = {Pool::insert(name), newNameCache()};
+    return BC(BC_t::dollar_, i);
+}
+BC BC::extractName(SEXP name) {
+    assert(TYPEOF(name) == SYMSXP);
+    immediate_t i;
+    i.name_cache = {Pool::insert(name), newNameCache()};
+    return BC(BC_t::extract_name_, i);
+}
+BC BC::subassignDollar(SEXP sym, SEXP name) {
+    assert(TYPEOF(sym) == SYMSXP && strlen(CHAR(PRINTNAME(sym))));
+    assert(TYPEOF(name) == SYMSXP);
+    immediate_t i;
+    i.assign_name = {Pool::insert(sym), Pool::insert(name), newNameCache()};
+    return BC(BC_t::subassign_dollar_, i);
+}
+BC BC::subassign2Name(SEXP sym, SEXP name) {
+    assert(TYPEOF(sym) == SYMSXP && strlen(CHAR(PRINTNAME(sym))));
+    assert(TYPEOF(name) == SYMSXP);
+    immediate_t i;
+    i.assign_name = {Pool::insert(sym), Pool::insert(name), newNameCache()};
+    return BC(BC_t::subassign2_name_, i);
+}
 BC BC::seq() { return BC(BC_t::seq_); }
 BC BC::asbool() { return BC(BC_t::asbool_); }
 
@@ -244,6 +365,8 @@ BC BC::alloc(int type) {
     i.i = type;
     return BC(BC_t::alloc_, i);
 }
+BC BC::allocAs() { return BC(BC_t::alloc_as_); }
+BC BC::setElt() { return BC(BC_t::set_elt_); }
 
 BC BC::isfun() { return BC(BC_t::isfun_); }
 
@@ -291,6 +414,17 @@ BC BC::mod() { return BC(BC_t::mod_); }
 BC BC::pow() { return BC(BC_t::pow_); }
 BC BC::sub() { return BC(BC_t::sub_); }
 BC BC::lt() { return BC(BC_t::lt_); }
+BC BC::gt() { return BC(BC_t::gt_); }
+BC BC::le() { return BC(BC_t::le_); }
+BC BC::ge() { return BC(BC_t::ge_); }
+BC BC::eq() { return BC(BC_t::eq_); }
+BC BC::ne() { return BC(BC_t::ne_); }
+BC BC::uminus() { return BC(BC_t::uminus_); }
+BC BC::notOp() { return BC(BC_t::not_); }
+BC BC::andOp() { return BC(BC_t::and_); }
+BC BC::orOp() { return BC(BC_t::or_); }
+BC BC::abs() { return BC(BC_t::abs_); }
+BC BC::modulus() { return BC(BC_t::modulus_); }
 BC BC::invisible() { return BC(BC_t::invisible_); }
 BC BC::visible() { return BC(BC_t::visible_); }
 BC BC::extract1() { return BC(BC_t::extract1_); }
@@ -318,6 +452,21 @@ BC BC::is(uint32_t i) {
     im.i = i;
     return BC(BC_t::is_, im);
 }
+BC BC::math1(uint32_t fun) {
+    immediate_t im;
+    im.i = fun;
+    return BC(BC_t::math1_, im);
+}
+BC BC::reduce(uint32_t reduction) {
+    immediate_t im;
+    im.i = reduction;
+    return BC(BC_t::reduce_, im);
+}
+BC BC::fusedArith(SEXP program, uint32_t nargs) {
+    immediate_t im;
+    im.fused_arith = {Pool::insert(program), nargs};
+    return BC(BC_t::fused_arith_, im);
+}
 BC BC::put(uint32_t i) {
     immediate_t im;
     im.i = i;
@@ -72,6 +72,19 @@ typedef struct {
     uint32_t expected;
     uint32_t id;
 } GuardFunArgs;
+typedef struct {
+    uint32_t program;
+    uint32_t nargs;
+} FusedArithArgs;
+typedef struct {
+    uint32_t name;
+    uint32_t cache;
+} NameCacheArgs;
+typedef struct {
+    uint32_t target;
+    uint32_t name;
+    uint32_t cache;
+} AssignNameArgs;
 #pragma pack(pop)
 
 static constexpr size_t MAX_NUM_ARGS = 1L << (8 * sizeof(pool_idx_t));
@@ -96,6 +109,9 @@ class BC {
     union immediate_t {
         CallArgs call_args;
         GuardFunArgs guard_fun_args;
+        FusedArithArgs fused_arith;
+        NameCacheArgs name_cache;
+        AssignNameArgs assign_name;
         uint32_t guard_id;
         pool_idx_t pool;
         fun_idx_t fun;
@@ -126,6 +142,8 @@ class BC {
             return immediate.call_args.nargs + 1;
         if (bc == BC_t::static_call_stack_ || bc == BC_t::dispatch_stack_)
             return immediate.call_args.nargs;
+        if (bc == BC_t::fused_arith_)
+            return immediate.fused_arith.nargs;
         return popCount(bc);
     }
     inline size_t pushCount() { return pushCount(bc); }
@@ -153,13 +171,15 @@ class BC {
     }
 
     bool isCallsite() {
-        return bc == BC_t::call_ || bc == BC_t::dispatch_ ||
+        return bc == BC_t::call_ || bc == BC_t::call_pic_ ||
+               bc == BC_t::dispatch_ ||
                bc == BC_t::call_stack_ || bc == BC_t::dispatch_stack_ ||
-               bc == BC_t::static_call_stack_;
+               bc == BC_t::static_call_stack_ || bc == BC_t::std_generic_;
     }
 
     bool hasPromargs() {
-        return bc == BC_t::call_ || bc == BC_t::dispatch_ ||
+        return bc == BC_t::call_ || bc == BC_t::call_pic_ ||
+               bc == BC_t::dispatch_ ||
                bc == BC_t::promise_ || bc == BC_t::push_code_;
     }
 
@@ -184,24 +204,36 @@ class BC {
     inline static BC push(double constant);
     inline static BC push(int constant);
     inline static BC push_code(fun_idx_t i);
+    inline static BC lazy(SEXP ast);
     inline static BC ldfun(SEXP sym);
     inline static BC ldvar(SEXP sym);
     inline static BC ldlval(SEXP sym);
     inline static BC ldarg(SEXP sym);
     inline static BC ldddvar(SEXP sym);
+    inline static BC staticCallStack(uint32_t nargs);
+    inline static BC callPic(uint32_t nargs);
     inline static BC promise(fun_idx_t prom);
     inline static BC ret();
     inline static BC pop();
     inline static BC force();
     inline static BC asast();
     inline static BC stvar(SEXP sym);
+    inline static BC unbind(SEXP sym);
     inline static BC missing(SEXP sym);
     inline static BC subassign();
     inline static BC subassign2(SEXP sym);
+    inline static BC subassignMat(SEXP sym);
+    inline static BC subassign2Mat(SEXP sym);
+    inline static BC dollar(SEXP name);
+    inline static BC extractName(SEXP name);
+    inline static BC subassignDollar(SEXP sym, SEXP name);
+    inline static BC subassign2Name(SEXP sym, SEXP name);
     inline static BC length();
     inline static BC names();
     inline static BC setNames();
     inline static BC alloc(int type);
+    inline static BC allocAs();
+    inline static BC setElt();
     inline static BC asbool();
     inline static BC beginloop(jmp_t);
     inline static BC endcontext();
@@ -228,12 +260,27 @@ class BC {
     inline static BC mod();
     inline static BC sub();
     inline static BC lt();
+    inline static BC gt();
+    inline static BC le();
+    inline static BC ge();
+    inline static BC eq();
+    inline static BC ne();
+    inline static BC uminus();
+    // not, and and or are reserved words in C++
+    inline static BC notOp();
+    inline static BC andOp();
+    inline static BC orOp();
+    inline static BC abs();
+    inline static BC modulus();
+    inline static BC math1(uint32_t fun);
+    inline static BC reduce(uint32_t reduction);
+    inline static BC fusedArith(SEXP program, uint32_t nargs);
     inline static BC seq();
     inline static BC uniq();
     inline static BC asLogical();
     inline static BC lglOr();
     inline static BC lglAnd();
-    inline static BC guardName(SEXP, SEXP);
+    inline static BC guardName(SEXP, SEXP, uint32_t = NO_DEOPT_INFO);
     inline static BC guardNamePrimitive(SEXP);
     inline static BC guardEnv(uint32_t id);
     inline static BC isfun();
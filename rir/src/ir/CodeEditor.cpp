@@ -16,6 +16,7 @@ CodeEditor::CodeEditor(SEXP in) {
         ::Function* f = isValidClosureSEXP(in);
         assert(f != nullptr);
         formals_ = FORMALS(in);
+        closureEnv_ = CLOENV(in);
         bc = BODY(in);
     }
     FunctionHandle fh(bc);
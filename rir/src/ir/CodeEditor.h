@@ -6,6 +6,8 @@
 #include "utils/FunctionHandle.h"
 #include "utils/CodeHandle.h"
 #include "interpreter/interp_context.h"
+#include "R/Protect.h"
+#include "utils/Pool.h"
 
 #include <set>
 #include <unordered_map>
@@ -283,6 +285,44 @@ class CodeEditor {
             return *this;
         }
 
+        // Inserts a call instruction together with its (heap allocated) call
+        // site, which is then owned by the editor
+        Cursor& insertCall(BC bc, CallSiteStruct* callSite) {
+            assert(bc.isCallsite());
+            *this << bc;
+            prev().pos->callSite = callSite;
+            return *this;
+        }
+
+        // Inserts a copy of an instruction of the same editor, together with
+        // its source and a copy of its call site
+        Cursor& insertCopy(Iterator from) {
+            BC bc = *from;
+            if (bc.isCallsite()) {
+                auto cs = from.callSite();
+                unsigned needed = CallSite_sizeOf(cs.cs);
+                CallSiteStruct* copy = (CallSiteStruct*)new char[needed];
+                memcpy(copy, cs.cs, needed);
+                // The caches are mutated in place, the copy needs its own
+                Protect p;
+                if (copy->hasSelector) {
+                    *CallSite_dispatchCache(copy) = Pool::insert(
+                        p(Rf_allocVector(VECSXP, DISPATCH_CACHE_SIZE)));
+                } else if (copy->hasInlineCache) {
+                    SEXP cache = Pool::get(*CallSite_inlineCache(copy));
+                    SEXP fresh = p(Rf_allocVector(VECSXP, XLENGTH(cache)));
+                    for (R_xlen_t j = 0; j < XLENGTH(cache); ++j)
+                        SET_VECTOR_ELT(fresh, j, VECTOR_ELT(cache, j));
+                    *CallSite_inlineCache(copy) = Pool::insert(fresh);
+                }
+                insertCall(bc, copy);
+            } else {
+                *this << bc;
+            }
+            prev().pos->srcIdx = from.pos->srcIdx;
+            return *this;
+        }
+
         void insert(CodeEditor& other) {
             editor.changed = true;
 
@@ -343,6 +383,7 @@ class CodeEditor {
                 }
                 // Fix prom offsets
                 if (insert->bc.bc == BC_t::call_ ||
+                    insert->bc.bc == BC_t::call_pic_ ||
                     insert->bc.bc == BC_t::dispatch_) {
                     auto cs = insert->callSite;
                     for (unsigned i = 0; i < cs->nargs; ++i) {
@@ -491,6 +532,10 @@ class CodeEditor {
         return * promises[index];
     }
 
+    bool hasPromise(size_t index) const {
+        return index < promises.size() && promises[index];
+    }
+
     void verify() {
         std::set<int> labels;
         BytecodeList* pos = front.next;
@@ -572,6 +617,8 @@ class CodeEditor {
 
     bool changed = false;
     SEXP formals_ = nullptr;
+    // The environment of the closure, if the editor was created from one
+    SEXP closureEnv_ = nullptr;
 };
 
 inline CodeEditor::Cursor CodeEditor::Iterator::asCursor(CodeEditor& editor) {
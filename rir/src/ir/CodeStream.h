@@ -69,6 +69,13 @@ class CodeStream {
         }
     }
 
+    // Every dispatch site starts with an empty cache of its own
+    static uint32_t newDispatchCache() {
+        Protect p;
+        return Pool::insert(
+            p(Rf_allocVector(VECSXP, DISPATCH_CACHE_SIZE)));
+    }
+
     CallSiteStruct* getNextCallSite(uint32_t needed) {
         needed = alignedSize(needed);
         CallSiteStruct* cs = (CallSiteStruct*)&callSites_[nextCallSiteIdx_];
@@ -96,18 +103,25 @@ class CodeStream {
                 }
             }
 
-        unsigned needed = CallSite_size(false, hasNames, false, nargs);
+        bool hasSelector =
+            bc == BC_t::dispatch_stack_ || bc == BC_t::std_generic_;
+        // The methods selected by standardGeneric
+        bool hasProfile = bc == BC_t::std_generic_;
+        unsigned needed =
+            CallSite_size(false, hasNames, hasProfile, hasSelector, nargs);
         ensureCallSiteSize(needed);
 
         CallSiteStruct* cs = getNextCallSite(needed);
 
         cs->nargs = nargs;
         cs->call = Pool::insert(call);
-        cs->hasProfile = false;
+        cs->hasProfile = hasProfile;
         cs->hasNames = hasNames;
-        cs->hasSelector = (bc == BC_t::dispatch_stack_);
+        cs->hasSelector = hasSelector;
         cs->hasTarget = (bc == BC_t::static_call_stack_);
         cs->hasImmediateArgs = false;
+        cs->forceFirstArg = false;
+        cs->hasInlineCache = false;
 
         if (hasNames) {
             for (unsigned i = 0; i < nargs; ++i) {
@@ -115,9 +129,10 @@ class CodeStream {
             }
         }
 
-        if (bc == BC_t::dispatch_stack_) {
+        if (hasSelector) {
             assert(TYPEOF(targOrSelector) == SYMSXP);
             *CallSite_selector(cs) = Pool::insert(targOrSelector);
+            *CallSite_dispatchCache(cs) = newDispatchCache();
         } else if (bc == BC_t::static_call_stack_) {
             assert(TYPEOF(targOrSelector) == CLOSXP ||
                    TYPEOF(targOrSelector) == BUILTINSXP);
@@ -129,7 +144,8 @@ class CodeStream {
 
     CodeStream& insertCall(BC_t bc, std::vector<fun_idx_t> args,
                            std::vector<SEXP> names, SEXP call,
-                           SEXP selector = nullptr) {
+                           SEXP selector = nullptr,
+                           bool forceFirstArg = false) {
         uint32_t nargs = args.size();
 
         insert(bc);
@@ -148,7 +164,9 @@ class CodeStream {
                 }
             }
 
-        unsigned needed = CallSite_size(true, hasNames, true, nargs);
+        bool hasSelector = bc == BC_t::dispatch_;
+        unsigned needed =
+            CallSite_size(true, hasNames, true, hasSelector, nargs);
         ensureCallSiteSize(needed);
 
         CallSiteStruct* cs = getNextCallSite(needed);
@@ -157,8 +175,10 @@ class CodeStream {
         cs->call = Pool::insert(call);
         cs->hasProfile = true;
         cs->hasNames = hasNames;
-        cs->hasSelector = (bc == BC_t::dispatch_);
+        cs->hasSelector = hasSelector;
         cs->hasImmediateArgs = true;
+        cs->forceFirstArg = forceFirstArg;
+        cs->hasInlineCache = false;
 
         int i = 0;
         for (auto arg : args) {
@@ -172,6 +192,7 @@ class CodeStream {
             assert(selector);
             assert(TYPEOF(selector) == SYMSXP);
             *CallSite_selector(cs) = Pool::insert(selector);
+            *CallSite_dispatchCache(cs) = newDispatchCache();
         }
 
         return *this;
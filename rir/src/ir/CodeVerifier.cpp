@@ -169,10 +169,16 @@ void CodeVerifier::vefifyFunctionLayout(SEXP sexp, ::Context* ctx) {
             assert(!cs->hasTarget);
             SEXP selector = cp_pool_at(ctx, *CallSite_selector(cs));
             assert(TYPEOF(selector) == SYMSXP);
+            SEXP cache = cp_pool_at(ctx, *CallSite_dispatchCache(cs));
+            assert(TYPEOF(cache) == VECSXP &&
+                   XLENGTH(cache) == DISPATCH_CACHE_SIZE);
         } else if (cs->hasTarget) {
             assert(!cs->hasSelector);
             SEXP selector = cp_pool_at(ctx, *CallSite_target(cs));
             assert(TYPEOF(selector) == SYMSXP);
+        } else if (cs->hasInlineCache) {
+            SEXP cache = cp_pool_at(ctx, *CallSite_inlineCache(cs));
+            assert(TYPEOF(cache) == VECSXP);
         } else {
             assert(cs->trg == 0);
         }
@@ -195,7 +201,8 @@ void CodeVerifier::vefifyFunctionLayout(SEXP sexp, ::Context* ctx) {
                 assert(TYPEOF(sym) == SYMSXP);
                 assert(strlen(CHAR(PRINTNAME(sym))));
             }
-            if (*cptr == BC_t::dispatch_stack_ || *cptr == BC_t::call_stack_) {
+            if (*cptr == BC_t::dispatch_stack_ || *cptr == BC_t::call_stack_ ||
+                *cptr == BC_t::std_generic_) {
                 unsigned callIdx = *reinterpret_cast<ArgT*>(cptr + 1);
                 CallSiteStruct* cs = CallSite_get(c, callIdx);
                 uint32_t nargs = *reinterpret_cast<ArgT*>(cptr + 5);
@@ -211,7 +218,8 @@ void CodeVerifier::vefifyFunctionLayout(SEXP sexp, ::Context* ctx) {
                         }
                     }
                 }
-                if (*cptr == BC_t::dispatch_stack_) {
+                if (*cptr == BC_t::dispatch_stack_ ||
+                    *cptr == BC_t::std_generic_) {
                     SEXP selector = cp_pool_at(ctx, *CallSite_selector(cs));
                     assert(TYPEOF(selector) == SYMSXP);
                 }
@@ -226,7 +234,8 @@ void CodeVerifier::vefifyFunctionLayout(SEXP sexp, ::Context* ctx) {
                     }
                 assert(ok and "Invalid promise offset detected");
             }
-            if (*cptr == BC_t::call_ || *cptr == BC_t::dispatch_) {
+            if (*cptr == BC_t::call_ || *cptr == BC_t::call_pic_ ||
+                *cptr == BC_t::dispatch_) {
                 unsigned callIdx = *reinterpret_cast<ArgT*>(cptr + 1);
                 CallSiteStruct* cs = CallSite_get(c, callIdx);
                 uint32_t nargs = *reinterpret_cast<ArgT*>(cptr + 5);
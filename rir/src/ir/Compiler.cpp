@@ -43,9 +43,17 @@ class Context {
 
     FunctionHandle& fun;
     Preserve& preserve;
+    SEXP formals;
 
-    Context(FunctionHandle& fun, Preserve& preserve)
-        : fun(fun), preserve(preserve) {}
+    Context(FunctionHandle& fun, Preserve& preserve, SEXP formals)
+        : fun(fun), preserve(preserve), formals(formals) {}
+
+    bool hasDots() {
+        for (auto f = RList(formals).begin(); f != RList::end(); ++f)
+            if (f.tag() == R_DotsSymbol)
+                return true;
+        return false;
+    }
 
     bool inLoop() { return !code.top().loops.empty(); }
 
@@ -69,6 +77,7 @@ class Context {
 fun_idx_t compilePromise(Context& ctx, SEXP exp);
 void compileExpr(Context& ctx, SEXP exp);
 void compileCall(Context& ctx, SEXP ast, SEXP fun, SEXP args);
+void compileCallArgs(Context& ctx, SEXP ast, SEXP args);
 
 void compileDispatch(Context& ctx, SEXP selector, SEXP ast, SEXP fun,
                      SEXP args) {
@@ -103,6 +112,154 @@ void compileDispatch(Context& ctx, SEXP selector, SEXP ast, SEXP fun,
     ctx.cs().insertCall(BC_t::dispatch_, callArgs, names, ast, selector);
 }
 
+// Returns the symbol for a constant element name as in x$name or x[["name"]],
+// or nullptr if idx is not such a name. Only plain ascii names qualify, since
+// the interpreter compares them by CHARSXP identity.
+SEXP constantName(SEXP idx, bool allowSymbol) {
+    SEXP name = nullptr;
+    if (allowSymbol && TYPEOF(idx) == SYMSXP && idx != R_DotsSymbol &&
+        idx != R_MissingArg)
+        name = PRINTNAME(idx);
+    else if (TYPEOF(idx) == STRSXP && Rf_length(idx) == 1 &&
+             ATTRIB(idx) == R_NilValue && STRING_ELT(idx, 0) != NA_STRING)
+        name = STRING_ELT(idx, 0);
+    if (!name || !*CHAR(name))
+        return nullptr;
+    for (const char* c = CHAR(name); *c; ++c)
+        if ((unsigned char)*c > 127)
+            return nullptr;
+    return Rf_install(CHAR(name));
+}
+
+// Body of the apply loop, the stack layout is [ans, X, i]. As in do_lapply
+// the index is bound to i and FUN(X[[i]], ...) is called with its first
+// argument forced, leaving [ans].
+void compileApplyLoop(Context& ctx, SEXP fun, SEXP elt, SEXP call, bool dots,
+                      Label done) {
+    CodeStream& cs = ctx.cs();
+    static SEXP isym = Rf_install("i");
+
+    Label loopBranch = cs.mkLabel();
+    Label endBranch = cs.mkLabel();
+
+    cs << loopBranch
+       << BC::inc()
+       << BC::testBounds()
+       << BC::brfalse(endBranch)
+       << BC::dup()
+       << BC::stvar(isym)
+       << BC::ldfun(fun);
+
+    // Without the dots this is a plain call the inliner can handle
+    std::vector<fun_idx_t> callArgs = {compilePromise(ctx, elt)};
+    if (dots)
+        callArgs.push_back(DOTS_ARG_IDX);
+    cs.insertCall(BC_t::call_, callArgs, {}, call, nullptr, true);
+
+    cs << BC::pull(1)
+       << BC::pick(4)
+       << BC::setElt()
+       << BC::put(2)
+       << BC::br(loopBranch);
+
+    cs << endBranch
+       << BC::pop()
+       << BC::pop()
+       << BC::visible()
+       << BC::br(done);
+}
+
+// Lowers .Internal(lapply(X, FUN)) and .Internal(vapply(X, FUN, FUN.VALUE,
+// USE.NAMES)) into a loop, the way base calls them. For vapply the result is
+// preallocated with the type of FUN.VALUE, if that is not an atomic scalar we
+// still call the .Internal.
+bool compileApply(Context& ctx, SEXP ast, SEXP fun, RList args) {
+    CodeStream& cs = ctx.cs();
+    bool vapply = fun == symbol::vapply;
+
+    // FUN(X[[i]], ...) is evaluated in the current frame
+    if (args.length() != (vapply ? 4 : 2) || !ctx.hasDots())
+        return false;
+    for (auto a : args)
+        if (TYPEOF(a) != SYMSXP || DDVAL(a) || a == R_DotsSymbol)
+            return false;
+
+    static SEXP isym = Rf_install("i");
+    Protect p;
+    SEXP elt = p(LCONS(symbol::DoubleBracket,
+                       LCONS(args[0], LCONS(isym, R_NilValue))));
+    SEXP call = p(LCONS(args[1], LCONS(elt, LCONS(R_DotsSymbol, R_NilValue))));
+
+    Label dotsBranch = cs.mkLabel();
+    Label genericBranch = cs.mkLabel();
+    Label doneBranch = cs.mkLabel();
+
+    cs << BC::guardNamePrimitive(symbol::Internal)
+       << BC::ldvar(args[0])
+       << BC::dup()
+       << BC::length();
+
+    if (vapply) {
+        Label haveNamesBranch = cs.mkLabel();
+        Label charNamesBranch = cs.mkLabel();
+        Label namedBranch = cs.mkLabel();
+
+        cs << BC::ldvar(args[2])
+           << BC::allocAs()
+           << BC::dup()
+           << BC::is(NILSXP)
+           << BC::brtrue(genericBranch);
+
+        // USE.NAMES takes the names of X, or X itself if it is character
+        cs << BC::ldvar(args[3])
+           << BC::asbool()
+           << BC::brfalse(namedBranch)
+           << BC::pull(1)
+           << BC::dup()
+           << BC::names()
+           << BC::dup()
+           << BC::is(NILSXP)
+           << BC::brfalse(haveNamesBranch)
+           << BC::pop()
+           << BC::dup()
+           << BC::is(STRSXP)
+           << BC::brtrue(charNamesBranch)
+           << BC::pop()
+           << BC::br(namedBranch);
+
+        cs << haveNamesBranch
+           << BC::swap()
+           << BC::pop()
+           << charNamesBranch
+           << BC::setNames()
+           << namedBranch;
+    } else {
+        cs << BC::alloc(VECSXP)
+           << BC::pull(1)
+           << BC::names()
+           << BC::setNames();
+    }
+
+    cs << BC::swap()
+       << BC::push((int)0)
+       << BC::missing(R_DotsSymbol)
+       << BC::brfalse(dotsBranch);
+    compileApplyLoop(ctx, args[1], elt, call, false, doneBranch);
+    cs << dotsBranch;
+    compileApplyLoop(ctx, args[1], elt, call, true, doneBranch);
+
+    if (vapply) {
+        cs << genericBranch
+           << BC::pop()
+           << BC::pop()
+           << BC::ldfun(symbol::Internal);
+        compileCallArgs(ctx, ast, CDR(ast));
+    }
+
+    cs << doneBranch;
+    return true;
+}
+
 // Inline some specials
 // TODO: once we have sufficiently powerful analysis this should (maybe?) go
 //       away and move to an optimization phase.
@@ -155,9 +312,12 @@ bool compileSpecialCall(Context& ctx, SEXP ast, SEXP fun, SEXP args_) {
     }
 
     if (args.length() == 2 &&
-        (fun == symbol::Add || fun == symbol::Sub || fun == symbol::Lt ||
-         fun == symbol::Mul || fun == symbol::Div || fun == symbol::Idiv ||
-         fun == symbol::Mod || fun == symbol::Pow)) {
+        (fun == symbol::Add || fun == symbol::Sub || fun == symbol::Mul ||
+         fun == symbol::Div || fun == symbol::Idiv || fun == symbol::Mod ||
+         fun == symbol::Pow || fun == symbol::Lt || fun == symbol::Gt ||
+         fun == symbol::Le || fun == symbol::Ge || fun == symbol::Eq ||
+         fun == symbol::Ne || fun == symbol::BitAnd ||
+         fun == symbol::BitOr)) {
         cs << BC::guardNamePrimitive(fun);
 
         compileExpr(ctx, args[0]);
@@ -169,6 +329,20 @@ bool compileSpecialCall(Context& ctx, SEXP ast, SEXP fun, SEXP args_) {
             cs << BC::sub();
         else if (fun == symbol::Lt)
             cs << BC::lt();
+        else if (fun == symbol::Gt)
+            cs << BC::gt();
+        else if (fun == symbol::Le)
+            cs << BC::le();
+        else if (fun == symbol::Ge)
+            cs << BC::ge();
+        else if (fun == symbol::Eq)
+            cs << BC::eq();
+        else if (fun == symbol::Ne)
+            cs << BC::ne();
+        else if (fun == symbol::BitAnd)
+            cs << BC::andOp();
+        else if (fun == symbol::BitOr)
+            cs << BC::orOp();
         else if (fun == symbol::Mul)
             cs << BC::mul();
         else if (fun == symbol::Div)
@@ -184,6 +358,69 @@ bool compileSpecialCall(Context& ctx, SEXP ast, SEXP fun, SEXP args_) {
         return true;
     }
 
+    if (args.length() == 1 && args[0] != R_DotsSymbol &&
+        args[0] != R_MissingArg &&
+        (fun == symbol::Sub || fun == symbol::Not || fun == symbol::Abs ||
+         fun == symbol::Modulus)) {
+        cs << BC::guardNamePrimitive(fun);
+
+        compileExpr(ctx, args[0]);
+
+        if (fun == symbol::Sub)
+            cs << BC::uminus();
+        else if (fun == symbol::Not)
+            cs << BC::notOp();
+        else if (fun == symbol::Abs)
+            cs << BC::abs();
+        else
+            cs << BC::modulus();
+        cs.addSrc(ast);
+
+        return true;
+    }
+
+    if (args.length() == 1 && args[0] != R_DotsSymbol &&
+        args[0] != R_MissingArg) {
+        static const SEXP math1Symbols[] = {
+#define V(name, cfun) Rf_install(#name),
+            MATH1_FUNCTIONS(V)
+#undef V
+        };
+        int math1 = -1;
+        for (int i = 0; i < numMath1_; ++i)
+            if (fun == math1Symbols[i])
+                math1 = i;
+        if (math1 != -1) {
+            cs << BC::guardNamePrimitive(fun);
+            compileExpr(ctx, args[0]);
+            cs << BC::math1(math1);
+            cs.addSrc(ast);
+            return true;
+        }
+
+        static const SEXP reductionSymbols[] = {
+#define V(name) Rf_install(#name),
+            REDUCTIONS(V)
+#undef V
+        };
+        int reduction = -1;
+        for (int i = 0; i < numReductions_; ++i)
+            if (fun == reductionSymbols[i])
+                reduction = i;
+        if (reduction != -1 && !args.begin().hasTag()) {
+            SEXP target = CDR(fun);
+            // mean is a closure, the others are builtins
+            if (TYPEOF(target) == CLOSXP)
+                cs << BC::guardName(fun, target);
+            else
+                cs << BC::guardNamePrimitive(fun);
+            compileExpr(ctx, args[0]);
+            cs << BC::reduce(reduction);
+            cs.addSrc(ast);
+            return true;
+        }
+    }
+
     if (fun == symbol::And && args.length() == 2) {
         cs << BC::guardNamePrimitive(fun);
 
@@ -306,83 +543,154 @@ bool compileSpecialCall(Context& ctx, SEXP ast, SEXP fun, SEXP args_) {
             }
         }
 
-        // 3) Special case [ and [[
+        // 3) Special case x$name and x[["name"]]
         if (lhsParts.size() == 2) {
             RList g(lhsParts[0]);
-            if (g.length() == 3) {
-                SEXP fun = *g.begin();
-                auto idx = g.begin() + 2;
-                if (*idx != R_DotsSymbol && *idx != R_MissingArg &&
-                    !idx.hasTag()) {
-                    if (fun == symbol::DoubleBracket ||
-                        fun == symbol::Bracket) {
-
-                        Label objBranch = cs.mkLabel();
-                        Label nextBranch = cs.mkLabel();
-
-                        // First rhs (assign is right-associative) 
-                        compileExpr(ctx, rhs);
-                        // Keep a copy of rhs since its the result of this
-                        // expression
-                        cs << BC::dup()
-                           << BC::uniq();
-
-                        // Now load target and index
-                        cs << BC::ldvar(target);
-                        compileExpr(ctx, *idx);
-
-                        // check for object case
-                        cs << BC::swap();
-                        cs << BC::brobj(objBranch);
-
-                        // do the thing
-                        if (fun == symbol::DoubleBracket)
-                            cs << BC::subassign2(target);
-                        else
-                            cs << BC::subassign();
-                        cs << BC::stvar(target);
-                        cs << BC::br(nextBranch);
-
-                        // In the case the target is an object:
-                        cs << objBranch;
-
-                        // We need a patched ast again :(
-                        SEXP setter = fun == symbol::DoubleBracket
-                                          ? symbol::AssignDoubleBracket
-                                          : symbol::AssignBracket;
-                        SEXP rewrite = Rf_shallow_duplicate(lhs);
-                        ctx.preserve(rewrite);
-                        SETCAR(rewrite, setter);
-
-                        SEXP a = CDR(rewrite);
-                        SETCAR(a, symbol::setterPlaceholder);
-                        while (CDR(a) != R_NilValue)
-                            a = CDR(a);
-                        SEXP value =
-                            CONS_NR(symbol::setterPlaceholder, R_NilValue);
-                        SET_TAG(value, symbol::value);
-                        SETCDR(a, value);
-
-                        // Reorder stack into correct ordering
-                        cs << BC::swap() << BC::pick(2);
-
-                        // Do dispatch using args from the stack
-                        cs.insertStackCall(
-                            BC_t::dispatch_stack_, 3,
-                            {R_NilValue, R_NilValue, symbol::value}, rewrite,
-                            setter);
-
-                        // store the result as "target"
-                        cs << BC::stvar(target);
-
-                        cs << nextBranch
-                           << BC::invisible();
-                        return true;
-                    }
-                }
+            SEXP fun = *g.begin();
+            SEXP name = nullptr;
+            if (g.length() == 3 && !(g.begin() + 2).hasTag() &&
+                (fun == symbol::Dollar || fun == symbol::DoubleBracket))
+                name = constantName(*(g.begin() + 2), fun == symbol::Dollar);
+
+            if (name) {
+                Label objBranch = cs.mkLabel();
+                Label nextBranch = cs.mkLabel();
+
+                compileExpr(ctx, rhs);
+                cs << BC::dup()
+                   << BC::uniq();
+
+                cs << BC::ldvar(target);
+                cs << BC::brobj(objBranch);
+
+                if (fun == symbol::Dollar)
+                    cs << BC::subassignDollar(target, name);
+                else
+                    cs << BC::subassign2Name(target, name);
+                cs.addSrc(ast);
+                cs << BC::stvar(target);
+                cs << BC::br(nextBranch);
+
+                // In the case the target is an object:
+                cs << objBranch;
+
+                SEXP setter = fun == symbol::Dollar
+                                  ? symbol::AssignDollar
+                                  : symbol::AssignDoubleBracket;
+                SEXP nameString = Rf_ScalarString(PRINTNAME(name));
+                ctx.preserve(nameString);
+                SEXP value = CONS_NR(symbol::setterPlaceholder, R_NilValue);
+                SET_TAG(value, symbol::value);
+                SEXP rewrite = LCONS(
+                    setter, LCONS(symbol::setterPlaceholder,
+                                  CONS_NR(nameString, value)));
+                ctx.preserve(rewrite);
+
+                // Reorder stack into correct ordering
+                cs << BC::push(nameString) << BC::pick(2);
+
+                cs.insertStackCall(BC_t::dispatch_stack_, 3,
+                                   {R_NilValue, R_NilValue, symbol::value},
+                                   rewrite, setter);
+
+                cs << BC::stvar(target);
+
+                cs << nextBranch
+                   << BC::invisible();
+                return true;
             }
+        }
+
+        // 4) Special case [ and [[ with one or two (matrix) indices
+        if (lhsParts.size() == 2) {
+            RList g(lhsParts[0]);
+            SEXP fun = *g.begin();
+            size_t nidx = g.length() - 2;
+
+            bool simpleIdx = nidx == 1 || nidx == 2;
+            for (auto idx = g.begin() + 2; simpleIdx && idx != g.end(); ++idx)
+                if (*idx == R_DotsSymbol || *idx == R_MissingArg ||
+                    idx.hasTag())
+                    simpleIdx = false;
+
+            if (simpleIdx &&
+                (fun == symbol::DoubleBracket || fun == symbol::Bracket)) {
+
+                Label objBranch = cs.mkLabel();
+                Label nextBranch = cs.mkLabel();
 
-            //            if (getter == symbol::Bracket)
+                // First rhs (assign is right-associative)
+                compileExpr(ctx, rhs);
+                // Keep a copy of rhs since its the result of this
+                // expression
+                cs << BC::dup()
+                   << BC::uniq();
+
+                // Now load target and indices
+                cs << BC::ldvar(target);
+                for (auto idx = g.begin() + 2; idx != g.end(); ++idx)
+                    compileExpr(ctx, *idx);
+
+                // check for object case
+                if (nidx == 1)
+                    cs << BC::swap();
+                else
+                    cs << BC::pick(2);
+                cs << BC::brobj(objBranch);
+
+                // do the thing
+                if (nidx == 1) {
+                    if (fun == symbol::DoubleBracket)
+                        cs << BC::subassign2(target);
+                    else
+                        cs << BC::subassign();
+                } else {
+                    if (fun == symbol::DoubleBracket)
+                        cs << BC::subassign2Mat(target);
+                    else
+                        cs << BC::subassignMat(target);
+                }
+                cs << BC::stvar(target);
+                cs << BC::br(nextBranch);
+
+                // In the case the target is an object:
+                cs << objBranch;
+
+                // We need a patched ast again :(
+                SEXP setter = fun == symbol::DoubleBracket
+                                  ? symbol::AssignDoubleBracket
+                                  : symbol::AssignBracket;
+                SEXP rewrite = Rf_shallow_duplicate(lhs);
+                ctx.preserve(rewrite);
+                SETCAR(rewrite, setter);
+
+                SEXP a = CDR(rewrite);
+                SETCAR(a, symbol::setterPlaceholder);
+                while (CDR(a) != R_NilValue)
+                    a = CDR(a);
+                SEXP value = CONS_NR(symbol::setterPlaceholder, R_NilValue);
+                SET_TAG(value, symbol::value);
+                SETCDR(a, value);
+
+                // Reorder stack into correct ordering
+                if (nidx == 1)
+                    cs << BC::swap() << BC::pick(2);
+                else
+                    cs << BC::put(3) << BC::pick(2);
+
+                // Do dispatch using args from the stack
+                std::vector<SEXP> names(nidx + 1, R_NilValue);
+                names.push_back(symbol::value);
+                cs.insertStackCall(BC_t::dispatch_stack_, nidx + 2, names,
+                                   rewrite, setter);
+
+                // store the result as "target"
+                cs << BC::stvar(target);
+
+                cs << nextBranch
+                   << BC::invisible();
+                return true;
+            }
         }
 
         compileExpr(ctx, rhs);
@@ -593,6 +901,51 @@ bool compileSpecialCall(Context& ctx, SEXP ast, SEXP fun, SEXP args_) {
         return true;
     }
 
+    if ((fun == symbol::Dollar || fun == symbol::DoubleBracket) &&
+        args.length() == 2) {
+        auto lhs = args.begin();
+        auto idx = args.begin() + 1;
+        SEXP name = constantName(*idx, fun == symbol::Dollar);
+
+        if (name && *lhs != R_DotsSymbol && *lhs != R_MissingArg &&
+            !lhs.hasTag() && !idx.hasTag()) {
+            Label objBranch = cs.mkLabel();
+            Label nextBranch = cs.mkLabel();
+
+            cs << BC::guardNamePrimitive(fun);
+            compileExpr(ctx, *lhs);
+            cs << BC::brobj(objBranch);
+
+            if (fun == symbol::Dollar)
+                cs << BC::dollar(name);
+            else
+                cs << BC::extractName(name);
+            cs.addSrc(ast);
+
+            cs << BC::br(nextBranch);
+
+            cs << objBranch;
+            if (fun == symbol::Dollar) {
+                // Methods for `$` get the name as a string, and the object is
+                // already evaluated, so dispatch with args from the stack
+                SEXP nameString = Rf_ScalarString(PRINTNAME(name));
+                ctx.preserve(nameString);
+                SEXP rewrite =
+                    LCONS(fun, LCONS(symbol::getterPlaceholder,
+                                     LCONS(nameString, R_NilValue)));
+                ctx.preserve(rewrite);
+                cs << BC::push(nameString);
+                cs.insertStackCall(BC_t::dispatch_stack_, 2, {}, rewrite,
+                                   fun);
+            } else {
+                compileDispatch(ctx, fun, ast, fun, args_);
+            }
+
+            cs << nextBranch;
+            return true;
+        }
+    }
+
     if (fun == symbol::DoubleBracket || fun == symbol::Bracket) {
         if (args.length() == 2 || args.length() == 3) {
             auto lhs = *args.begin();
@@ -808,105 +1161,23 @@ bool compileSpecialCall(Context& ctx, SEXP ast, SEXP fun, SEXP args_) {
             }
 
 
-            if (false && fun == symbol::lapply && args.length() == 2) {
-                Label loopBranch = cs.mkLabel();
-                Label nextBranch = cs.mkLabel();
-
-                compileExpr(ctx, args[0]);
-
-                // get length and names of the vector X
-                cs << BC::dup()
-                   << BC::dup()
-                   << BC::names()
-                   << BC::swap()
-                   << BC::length()
-                   << BC::dup()
-                   << BC::uniq()
-                   << BC::inc()
-                   << BC::swap()
-                   // allocate the ans vector with same size and names
-                   << BC::alloc(VECSXP)
-                   << BC::pick(2)
-                   << BC::setNames()
-                   << BC::swap()
-                   // Put the counter in place
-                   << BC::push((int)0);
-
-                // lookup of the function to apply
-                if (TYPEOF(args[1]) == SYMSXP) {
-                    cs << BC::ldfun(args[1]);
-                } else if (TYPEOF(args[1]) == STRSXP) {
-                    assert(Rf_length(args[1]) == 1);
-                    cs << BC::ldfun(Rf_install(CHAR(STRING_ELT(args[1], 0))));
-                } else {
-                    compileExpr(ctx, args[1]);
-                    cs << BC::isfun();
-                }
-                cs << BC::put(4);
-
-                // loop invariant stack layout: [fun, X, ans, len(vector)+1, i]
-
-                // check end condition
-                cs << loopBranch
-                   << BC::inc()
-                   << BC::dup2()
-                   << BC::swap()
-                   << BC::lt()
-                   << BC::brfalse(nextBranch);
-
-                // X[[i]]
-                Label objBranch = cs.mkLabel();
-                Label contBranch = cs.mkLabel();
-
-                cs << BC::guardNamePrimitive(symbol::DoubleBracket);
-                cs << BC::pull(4)
-                   << BC::pull(4)
-                   << BC::pull(2)
-                   << BC::brobj(objBranch);
-
-                cs << BC::extract1()
-                   << BC::br(contBranch);
-
-                static SEXP extractCall = nullptr;
-                if (!extractCall)
-                    extractCall = LCONS(symbol::DoubleBracket,
-                                LCONS(symbol::getterPlaceholder, R_NilValue));
-
-                cs << objBranch;
-                cs.insertStackCall(BC_t::dispatch_stack_, 2, {}, extractCall,
-                                   symbol::DoubleBracket);
-
-                cs << contBranch;
-
-                // f(X[[i]])
-                SEXP rewritten = LCONS(args[1],
-                        LCONS(symbol::getterPlaceholder, R_NilValue));
-
-                cs.insertStackCall(BC_t::call_stack_, 1, {}, rewritten);
-
-                // store result
-                cs << BC::pull(1)
-                   << BC::pick(4)
-                   << BC::subassign2(R_NilValue)
-                   << BC::put(2)
-                   << BC::br(loopBranch);
-
-                // Put ans to the top and remove rest
-                cs << nextBranch
-                   << BC::pop()
-                   << BC::pop()
-                   << BC::swap()
-                   << BC::pop()
-                   << BC::swap()
-                   << BC::pop()
-                   << BC::visible();
-
-                return true;
-            }
+            if (fun == symbol::lapply || fun == symbol::vapply)
+                return compileApply(ctx, ast, fun, args);
         }
     }
 
 
+    // standardGeneric("f") in the body of the generic f
+    if (fun == symbol::standardGeneric && args.length() == 1 &&
+        !args.begin().hasTag() && TYPEOF(args[0]) == STRSXP &&
+        XLENGTH(args[0]) == 1 && STRING_ELT(args[0], 0) != NA_STRING &&
+        (TYPEOF(CDR(fun)) == BUILTINSXP || TYPEOF(CDR(fun)) == SPECIALSXP)) {
+        SEXP generic = Rf_install(CHAR(STRING_ELT(args[0], 0)));
+        cs << BC::guardNamePrimitive(fun);
+        cs.insertStackCall(BC_t::std_generic_, 0, {}, ast, generic);
+        return true;
+    }
+
     SEXP builtin = fun->u.symsxp.value;
     if (TYPEOF(builtin) == BUILTINSXP) {
         for (auto a = args.begin(); a != args.end(); ++a)
@@ -951,6 +1222,12 @@ void compileCall(Context& ctx, SEXP ast, SEXP fun, SEXP args) {
         });
     }
 
+    compileCallArgs(ctx, ast, args);
+}
+
+void compileCallArgs(Context& ctx, SEXP ast, SEXP args) {
+    CodeStream& cs = ctx.cs();
+
     // Process arguments:
     // Arguments can be optionally named
     std::vector<fun_idx_t> callArgs;
@@ -1046,9 +1323,27 @@ std::vector<fun_idx_t> compileFormals(Context& ctx, SEXP formals) {
     return res;
 }
 
+// Promises larger than that are only compiled when they are forced
+const unsigned LAZY_PROMISE_SIZE = 64;
+
+// Whether the ast has more than max nodes
+bool largerThan(SEXP exp, unsigned max, unsigned& size) {
+    if (++size > max)
+        return true;
+    if (TYPEOF(exp) == LANGSXP || TYPEOF(exp) == LISTSXP)
+        for (auto e : RList(exp))
+            if (largerThan(e, max, size))
+                return true;
+    return false;
+}
+
 fun_idx_t compilePromise(Context& ctx, SEXP exp) {
     ctx.push(exp);
-    compileExpr(ctx, exp);
+    unsigned size = 0;
+    if (TYPEOF(exp) == LANGSXP && largerThan(exp, LAZY_PROMISE_SIZE, size))
+        ctx.cs() << BC::lazy(exp);
+    else
+        compileExpr(ctx, exp);
     ctx.cs() << BC::ret();
     return ctx.pop();
 }
@@ -1058,7 +1353,7 @@ Compiler::CompilerRes Compiler::finalize() {
     // Rprintf("****************************************************\n");
     // Rprintf("Compiling function\n");
     FunctionHandle function = FunctionHandle::create();
-    Context ctx(function, preserve);
+    Context ctx(function, preserve, formals);
 
     auto formProm = compileFormals(ctx, formals);
 
@@ -1,7 +1,12 @@
 #include "ir/Optimizer.h"
 #include "optimizer/cleanup.h"
 #include "optimizer/stupid_inline.h"
+#include "optimizer/closure_inline.h"
 #include "optimizer/localize.h"
+#include "optimizer/fusion.h"
+#include "optimizer/native_calls.h"
+#include "optimizer/inline_cache.h"
+#include "optimizer/superblock.h"
 
 namespace rir {
 
@@ -29,6 +34,46 @@ bool Optimizer::inliner(CodeEditor& code, bool stable) {
     StupidInliner inl(code);
     inl.run();
     changed = changed || code.changed;
+    if (code.changed)
+        code.commit();
+    // The locals of the callee end up in our environment
+    if (stable) {
+        ClosureInliner closures(code);
+        closures.run();
+        changed = changed || code.changed;
+        if (code.changed)
+            code.commit();
+    }
+    NativeCalls native(code);
+    native.run();
+    changed = changed || code.changed;
+    if (code.changed)
+        code.commit();
+    return changed;
+}
+
+bool Optimizer::fuse(CodeEditor& code) {
+    ArithFusion fusion(code);
+    fusion.run();
+    bool changed = code.changed;
+    if (code.changed)
+        code.commit();
+    return changed;
+}
+
+bool Optimizer::cacheCalls(CodeEditor& code) {
+    InlineCaches caches(code);
+    caches.run();
+    bool changed = code.changed;
+    if (code.changed)
+        code.commit();
+    return changed;
+}
+
+bool Optimizer::superblock(CodeEditor& code, Trace const& trace) {
+    Superblock superblock(code, trace);
+    superblock.run();
+    bool changed = code.changed;
     if (code.changed)
         code.commit();
     return changed;
@@ -46,6 +91,15 @@ SEXP Optimizer::reoptimizeFunction(SEXP s) {
         if (!changedInl && !changedOpt)
             break;
     }
+    // The remaining calls could not be inlined, at least make them cheaper
+    Optimizer::cacheCalls(code);
+    // After the others, so that constant folding still sees the single
+    // operations
+    Optimizer::fuse(code);
+    // The superblock copies the loop as the other passes left it
+    Trace trace;
+    if (Trace_take(fun, &trace))
+        Optimizer::superblock(code, trace);
 
     FunctionHandle opt = code.finalize();
     CodeVerifier::vefifyFunctionLayout(opt.store, globalContext());
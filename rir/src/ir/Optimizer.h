@@ -2,6 +2,7 @@
 #define RIR_OPTIMIZER_H
 
 #include "ir/CodeEditor.h"
+#include "interpreter/trace.h"
 
 namespace rir {
 
@@ -9,6 +10,9 @@ class Optimizer {
   public:
     static bool optimize(CodeEditor&, int steam = 2);
     static bool inliner(CodeEditor&, bool stableEnv);
+    static bool fuse(CodeEditor&);
+    static bool cacheCalls(CodeEditor&);
+    static bool superblock(CodeEditor&, Trace const&);
     static SEXP reoptimizeFunction(SEXP);
 };
 }
@@ -17,6 +17,11 @@ DEF_INSTR(push_code_, 1, 0, 1, 1)
  * push_code_:: take immediate code object index, and push code object onto obj
  * stack
  */
+DEF_INSTR(lazy_, 1, 0, 1, 0)
+/**
+ * lazy_:: take immediate CP index of a (ast, code) list, compile the ast into
+ * code the first time, evaluate the code in env and push the result
+ */
 DEF_INSTR(ldfun_, 1, 0, 1, 0)
 /**
  * ldfun_:: take immediate CP index of dd symbol (eg. ..1), find binding in env
@@ -42,6 +47,11 @@ DEF_INSTR(call_, 2, 1, 1, 0)
 /**
  * call_:: ... Takes a list of code objects, which represent the arguments, decides on eager/lazy evaluation and does the right thing with the code objs.
  */
+DEF_INSTR(call_pic_, 2, 1, 1, 0)
+/**
+ * call_pic_:: like call_, but the callee is first compared to the closures
+ *             cached at the call site, a hit is called without further checks
+ */
 DEF_INSTR(promise_, 1, 0, 1, 1)
 /**
  * promise_:: take immediate CP index of Code, create promise & push on object
@@ -75,6 +85,10 @@ DEF_INSTR(stvar_, 1, 1, 0, 1)
 /**
  * stvar_:: assign tos to the immediate symbol
  */
+DEF_INSTR(unbind_, 1, 0, 0, 1)
+/**
+ * unbind_:: remove the binding of the immediate symbol from the local frame
+ */
 DEF_INSTR(asbool_, 0, 1, 1, 0)
 /**
  * asbool_:: pop object stack, convert to Logical vector of size 1 and push on object stack. Throws an error if the result would be NA.
@@ -121,6 +135,53 @@ DEF_INSTR(idiv_, 0, 2, 1, 0)
 DEF_INSTR(mod_, 0, 2, 1, 0)
 DEF_INSTR(sub_, 0, 2, 1, 0)
 DEF_INSTR(lt_, 0, 2, 1, 0)
+DEF_INSTR(gt_, 0, 2, 1, 0)
+DEF_INSTR(le_, 0, 2, 1, 0)
+DEF_INSTR(ge_, 0, 2, 1, 0)
+DEF_INSTR(eq_, 0, 2, 1, 0)
+DEF_INSTR(ne_, 0, 2, 1, 0)
+/**
+ * lt_, gt_, le_, ge_, eq_, ne_:: pop two values from object stack, compare
+ * them, push the logical result on object stack
+ */
+DEF_INSTR(uminus_, 0, 1, 1, 0)
+/**
+ * uminus_:: pop value from object stack, push its negation
+ */
+DEF_INSTR(not_, 0, 1, 1, 0)
+/**
+ * not_:: pop value from object stack, push its elementwise logical negation
+ */
+DEF_INSTR(and_, 0, 2, 1, 0)
+DEF_INSTR(or_, 0, 2, 1, 0)
+/**
+ * and_, or_:: pop two values from object stack, push their elementwise
+ * logical (ternary) and/or. Unlike lgl_and_ these work on vectors.
+ */
+DEF_INSTR(abs_, 0, 1, 1, 0)
+/**
+ * abs_:: pop value from object stack, push its absolute value
+ */
+DEF_INSTR(modulus_, 0, 1, 1, 0)
+/**
+ * modulus_:: pop value from object stack, push its (complex) modulus
+ */
+DEF_INSTR(math1_, 1, 1, 1, 0)
+/**
+ * math1_:: pop value from object stack, push the result of the math function
+ *          immediate (see MATH1_FUNCTIONS) applied to it
+ */
+DEF_INSTR(reduce_, 1, 1, 1, 0)
+/**
+ * reduce_:: pop value from object stack, push the result of the reduction
+ *           immediate (see REDUCTIONS) applied to it
+ */
+DEF_INSTR(fused_arith_, 2, -1, 1, 0)
+/**
+ * fused_arith_:: pop n values from object stack, push the result of the
+ *                arithmetic expression over them. Immediates are the program
+ *                (see optimizer/fusion.h) and n
+ */
 DEF_INSTR(guard_fun_, 3, 0, 0, 1)
 /**
  * guard_fun_:: takes symbol, target, id, checks findFun(symbol) == target
@@ -165,6 +226,11 @@ DEF_INSTR(dispatch_, 2, 1, 1, 0)
  * dispatch_:: similar to call, but receiver is tos and 3rd immediate
  *             is selector
  */
+DEF_INSTR(std_generic_, 2, 0, 1, 0)
+/**
+ * std_generic_:: standardGeneric for the generic in the selector of the call
+ *                site, with the methods selected cached at the site
+ */
 DEF_INSTR(swap_, 0, 2, 2, 1)
 /**
  * swap_:: swap two elements tos
@@ -232,6 +298,31 @@ DEF_INSTR(subassign2_, 1, 3, 1, 1)
 /**
  * subassign2_ :: [[<-(a,b,c)
  */
+DEF_INSTR(subassign_mat_, 1, 4, 1, 1)
+/**
+ * subassign_mat_ :: [<-(a,b,c,d), ie. a[b,c] <- d
+ */
+DEF_INSTR(subassign2_mat_, 1, 4, 1, 1)
+/**
+ * subassign2_mat_ :: [[<-(a,b,c,d), ie. a[[b,c]] <- d
+ */
+DEF_INSTR(dollar_, 2, 1, 1, 1)
+/**
+ * dollar_ :: a$name, where a is on the stack and no obj. Immediates are the
+ * name and a per site cache of its position
+ */
+DEF_INSTR(extract_name_, 2, 1, 1, 1)
+/**
+ * extract_name_ :: a[["name"]], like dollar_ but without partial matching
+ */
+DEF_INSTR(subassign_dollar_, 3, 2, 1, 1)
+/**
+ * subassign_dollar_ :: $<-(a,name,b). Immediates are target, name and cache
+ */
+DEF_INSTR(subassign2_name_, 3, 2, 1, 1)
+/**
+ * subassign2_name_ :: [[<-(a,"name",b). Immediates are target, name and cache
+ */
 DEF_INSTR(missing_, 1, 0, 1, 1)
 /**
  * missing_ :: check if symb is missing
@@ -250,10 +341,25 @@ DEF_INSTR(set_names_, 0, 2, 1, 1)
 // set names of a vector, takes vector and names, puts vector back
 DEF_INSTR(alloc_, 1, 1, 1, 1)
 // allocate vector. type immediate, length as integer on stack
+DEF_INSTR(alloc_as_, 0, 2, 1, 1)
+// allocate vector of the type of a scalar template, takes length and template.
+// pushes NULL if the template is not a plain atomic scalar
+DEF_INSTR(set_elt_, 0, 3, 1, 0)
+// store a value into a freshly allocated vector, takes value, index and
+// vector, puts vector back. atomic vectors take values of length one,
+// coercible to their type, as vapply does
 DEF_INSTR(pull_, 1, 0, 1, 1)
 // copy a value from the stack. examples: pull(0) == dup(), pull(1) takes 2nd
 // element on stack and pushes it
 DEF_INSTR(int3_, 0, 0, 0, 1)
 // low-level breakpoint
 
+/*
+ * Quickened instructions: the interpreter rewrites a generic instruction into
+ * one of these after its first execution, and back if the guard fails. They
+ * are never emitted, BC::decode reads them as the generic instruction.
+ */
+DEF_INSTR(extract1_real_, 0, 2, 1, 1)
+// extract1_ of a real vector without attributes with a numeric index
+
 #undef DEF_INSTR
@@ -231,11 +231,18 @@ protected:
     }
 
     void call_(CodeEditor::Iterator ins) override { current().setAsNotLeaf(); }
+    void call_pic_(CodeEditor::Iterator ins) override {
+        current().setAsNotLeaf();
+    }
 
     void dispatch_(CodeEditor::Iterator ins) override {}
 
     void dispatch_stack_(CodeEditor::Iterator ins) override {}
 
+    void std_generic_(CodeEditor::Iterator ins) override {
+        current().setAsNotLeaf();
+    }
+
     void call_stack_(CodeEditor::Iterator ins) override {}
 
     void stvar_(CodeEditor::Iterator ins) override {
@@ -70,7 +70,8 @@ class BCCleanup : public InstructionDispatcher::Receiver {
         }
     }
 
-    void add_(CodeEditor::Iterator ins) override {
+    // Evaluates op on the two constant tos values at compile time
+    void foldBinop(CodeEditor::Iterator ins, const char* op) {
         auto b = analysis[ins].stack()[0];
         auto a = analysis[ins].stack()[1];
         if (a.t == FValue::Type::Constant && b.t == FValue::Type::Constant) {
@@ -78,8 +79,8 @@ class BCCleanup : public InstructionDispatcher::Receiver {
             SEXP cb = analysis.constant(b);
             if (!isObject(ca) && !isObject(cb)) {
                 Protect p;
-                SEXP plus = Rf_install("+");
-                SEXP c = LCONS(plus->u.symsxp.value,
+                SEXP fun = Rf_install(op);
+                SEXP c = LCONS(fun->u.symsxp.value,
                                LCONS(ca, LCONS(cb, R_NilValue)));
                 p(c);
                 SEXP res = Rf_eval(c, R_BaseEnv);
@@ -90,45 +91,39 @@ class BCCleanup : public InstructionDispatcher::Receiver {
         }
     }
 
-    void sub_(CodeEditor::Iterator ins) override {
-        auto b = analysis[ins].stack()[0];
-        auto a = analysis[ins].stack()[1];
-        if (a.t == FValue::Type::Constant && b.t == FValue::Type::Constant) {
+    // Evaluates op on the constant tos value at compile time
+    void foldUnop(CodeEditor::Iterator ins, const char* op) {
+        auto a = analysis[ins].top();
+        if (a.t == FValue::Type::Constant) {
             SEXP ca = analysis.constant(a);
-            SEXP cb = analysis.constant(b);
-            if (!isObject(ca) && !isObject(cb)) {
+            if (!isObject(ca)) {
                 Protect p;
-                SEXP plus = Rf_install("-");
-                SEXP c = LCONS(plus->u.symsxp.value,
-                               LCONS(ca, LCONS(cb, R_NilValue)));
+                SEXP fun = Rf_install(op);
+                SEXP c = LCONS(fun->u.symsxp.value, LCONS(ca, R_NilValue));
                 p(c);
                 SEXP res = Rf_eval(c, R_BaseEnv);
                 auto cur = ins.asCursor(code_);
                 cur.remove();
-                cur << BC::pop() << BC::pop() << BC::push(res);
+                cur << BC::pop() << BC::push(res);
             }
         }
     }
 
-    void mul_(CodeEditor::Iterator ins) override {
-        auto b = analysis[ins].stack()[0];
-        auto a = analysis[ins].stack()[1];
-        if (a.t == FValue::Type::Constant && b.t == FValue::Type::Constant) {
-            SEXP ca = analysis.constant(a);
-            SEXP cb = analysis.constant(b);
-            if (!isObject(ca) && !isObject(cb)) {
-                Protect p;
-                SEXP plus = Rf_install("*");
-                SEXP c = LCONS(plus->u.symsxp.value,
-                               LCONS(ca, LCONS(cb, R_NilValue)));
-                p(c);
-                SEXP res = Rf_eval(c, R_BaseEnv);
-                auto cur = ins.asCursor(code_);
-                cur.remove();
-                cur << BC::pop() << BC::pop() << BC::push(res);
-            }
-        }
-    }
+    void add_(CodeEditor::Iterator ins) override { foldBinop(ins, "+"); }
+    void sub_(CodeEditor::Iterator ins) override { foldBinop(ins, "-"); }
+    void mul_(CodeEditor::Iterator ins) override { foldBinop(ins, "*"); }
+
+    void lt_(CodeEditor::Iterator ins) override { foldBinop(ins, "<"); }
+    void gt_(CodeEditor::Iterator ins) override { foldBinop(ins, ">"); }
+    void le_(CodeEditor::Iterator ins) override { foldBinop(ins, "<="); }
+    void ge_(CodeEditor::Iterator ins) override { foldBinop(ins, ">="); }
+    void eq_(CodeEditor::Iterator ins) override { foldBinop(ins, "=="); }
+    void ne_(CodeEditor::Iterator ins) override { foldBinop(ins, "!="); }
+
+    void uminus_(CodeEditor::Iterator ins) override { foldUnop(ins, "-"); }
+    void not_(CodeEditor::Iterator ins) override { foldUnop(ins, "!"); }
+    void and_(CodeEditor::Iterator ins) override { foldBinop(ins, "&"); }
+    void or_(CodeEditor::Iterator ins) override { foldBinop(ins, "|"); }
 
     void invisible_(CodeEditor::Iterator ins) override {
         if ((ins + 1) != code_.end()) {
@@ -144,7 +139,9 @@ class BCCleanup : public InstructionDispatcher::Receiver {
         if ((ins + 1) != code_.end()) {
             if ((*(ins + 1)).is(BC_t::stvar_) || (*(ins + 1)).is(BC_t::pop_) ||
                 (*(ins + 1)).is(BC_t::subassign_) ||
-                (*(ins + 1)).is(BC_t::subassign2_)) {
+                (*(ins + 1)).is(BC_t::subassign2_) ||
+                (*(ins + 1)).is(BC_t::subassign_mat_) ||
+                (*(ins + 1)).is(BC_t::subassign2_mat_)) {
                 ins.asCursor(code_).remove();
             }
         }
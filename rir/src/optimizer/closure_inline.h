@@ -0,0 +1,545 @@
+#ifndef RIR_CLOSURE_INLINE_H
+#define RIR_CLOSURE_INLINE_H
+
+#include "ir/CodeEditor.h"
+#include "interpreter/deoptimizer.h"
+#include "interpreter/interp_context.h"
+#include "ir/Compiler.h"
+#include "R/RList.h"
+#include "R/Symbols.h"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace rir {
+
+/** Inlines closures which were always called from the same call site, also
+ * if they have local variables and call other functions.
+ *
+ * The locals and arguments of the callee are renamed to symbols of their own
+ * (.inl.<callee>.<name>), which then live in the environment of the caller
+ * and are removed again at the end of the inlined code, unless promises of
+ * the inlined code refer to them. Therefore the lookup of the
+ * free variables of the callee has to end up at the same place, which is the
+ * case if both closures are defined in the same environment and the caller
+ * does not bind any of those names itself. The caller has to have a stable
+ * environment, otherwise there is no way to know the latter.
+ *
+ * An argument which is used only once (and not in a loop) is inlined at the
+ * use, as are default arguments in that case. Other arguments are bound to
+ * their promise, constant default arguments to their value.
+ *
+ * The inlined code is guarded by a guard_fun_ on the name of the callee,
+ * which deoptimizes to the original call if the name is bound to something
+ * else. This is also why only calls from the original code are inlined.
+ *
+ * Calls to functions which look at their caller's frame (sys.function,
+ * parent.frame, ...) and instructions which refer to the frame of the callee
+ * (return, missing, closures, ...) prevent inlining, the callee would see the
+ * frame of the caller instead. The same goes for the closures the callee
+ * calls, and the ones they call, since their parent frame becomes the frame
+ * of the caller. So do calls which went to anything else than rir closures
+ * and builtins (or were never taken), a special like switch evaluates the
+ * original ast, which does not know the renamed locals.
+ */
+class ClosureInliner {
+  public:
+    CodeEditor& code_;
+
+    ClosureInliner(CodeEditor& code) : code_(code) {}
+
+    void run() {
+        if (!code_.closureEnv_)
+            return;
+
+        findBindings(code_, callerBindings);
+        for (auto a : code_.arguments())
+            callerBindings.insert(a.first);
+
+        size_t growth = 0;
+        for (auto i = code_.begin(); i != code_.end(); ++i) {
+            if (!(*i).is(BC_t::call_))
+                continue;
+
+            CallSite cs = i.callSite();
+            if (cs.hasNames() || !cs.hasProfile())
+                continue;
+
+            bool plainArgs = true;
+            for (size_t j = 0; j < cs.nargs(); ++j)
+                if (cs.arg(j) == DOTS_ARG_IDX || cs.arg(j) == MISSING_ARG_IDX)
+                    plainArgs = false;
+            if (!plainArgs)
+                continue;
+
+            CallSiteProfile* p = cs.profile();
+            if (p->numTargets != 1 || p->targetsOverflow)
+                continue;
+
+            SEXP t = p->targets[0];
+            if (TYPEOF(t) != CLOSXP || CLOENV(t) != code_.closureEnv_)
+                continue;
+            Function* f = isValidClosureSEXP(t);
+            if (!f)
+                continue;
+
+            if (!worthInlining(p->taken, f->size) ||
+                growth + f->size > MAX_GROWTH)
+                continue;
+
+            auto ldfun = i - 1;
+            if (!(*ldfun).is(BC_t::ldfun_) || !ldfun.hasOrigin())
+                continue;
+
+            if (inlineCall(ldfun, cs, t, f))
+                growth += f->size;
+        }
+    }
+
+  private:
+    static constexpr size_t MAX_GROWTH = 4000;
+
+    // Hot call sites may inline bigger functions
+    static bool worthInlining(unsigned taken, unsigned size) {
+        if (taken < 50)
+            return false;
+        size_t budget = 200 + taken / 5;
+        return size <= (budget > 2000 ? 2000 : budget);
+    }
+
+    // Functions which would see the caller's frame instead of the callee's
+    static bool inspectsFrame(SEXP fun) {
+        static const std::unordered_set<std::string> names = {
+            "on.exit",     "sys.call",   "sys.function", "sys.frame",
+            "sys.frames",  "sys.calls",  "sys.parent",   "sys.parents",
+            "sys.on.exit", "sys.status", "parent.frame", "environment",
+            "nargs",       "missing",    "match.arg",    "match.call",
+            "match.fun",   "substitute", "bquote",       "eval",
+            "evalq",       "local",      "with",         "within",
+            "assign",      "get",        "get0",         "mget",
+            "exists",      "rm",         "ls",           "objects",
+            "UseMethod",   "NextMethod", "standardGeneric", "Recall",
+            "<<-",         "delayedAssign", "makeActiveBinding", "browser",
+            "function",    "return",     "do.call",      "subset",
+            "transform",   "forceAndCall"};
+        return names.count(CHAR(PRINTNAME(fun)));
+    }
+
+    // Specials get the ast of the call, which still has the names renamed in
+    // the code. Closures and builtins get the arguments as promises of the
+    // renamed code, or their values.
+    static bool promiseTarget(SEXP t) {
+        if (TYPEOF(t) == BUILTINSXP)
+            return true;
+        std::unordered_set<SEXP> seen;
+        return TYPEOF(t) == CLOSXP && isValidClosureSEXP(t) &&
+               leavesParentAlone(t, seen);
+    }
+
+    static constexpr size_t MAX_CALL_DEPTH = 4;
+
+    // A closure called by the inlined code, and everything it calls, must not
+    // look at its parent frame, that is the frame of the caller now. Its own
+    // frame is still its own.
+    static bool leavesParentAlone(SEXP t, std::unordered_set<SEXP>& seen) {
+        if (seen.count(t))
+            return true;
+        if (seen.size() == MAX_CALL_DEPTH)
+            return false;
+        seen.insert(t);
+        Function* f = isValidClosureSEXP(t);
+        CodeEditor e(f->origin ? f->origin : BODY(t));
+        bool res = leavesParentAlone(e, seen);
+        seen.erase(t);
+        return res;
+    }
+
+    static bool leavesParentAlone(CodeEditor& e,
+                                  std::unordered_set<SEXP>& seen) {
+        for (auto i = e.begin(); i != e.end(); ++i) {
+            BC bc = *i;
+            switch (bc.bc) {
+            case BC_t::ldfun_:
+                if (inspectsFrame(bc.immediateConst()))
+                    return false;
+                break;
+            case BC_t::call_:
+            case BC_t::call_pic_:
+            case BC_t::call_stack_: {
+                CallSite cs = i.callSite();
+                if (!cs.hasProfile())
+                    return false;
+                CallSiteProfile* p = cs.profile();
+                if (p->numTargets == 0 || p->targetsOverflow)
+                    return false;
+                for (size_t j = 0; j < p->numTargets; ++j)
+                    if (!calleeLeavesParentAlone(p->targets[j], seen))
+                        return false;
+                break;
+            }
+            case BC_t::static_call_stack_:
+                if (!calleeLeavesParentAlone(i.callSite().target(), seen))
+                    return false;
+                break;
+            default:
+                break;
+            }
+        }
+        for (size_t i = 0; i < e.numPromises(); ++i)
+            if (e.hasPromise(i) && !leavesParentAlone(e.promise(i), seen))
+                return false;
+        return true;
+    }
+
+    static bool calleeLeavesParentAlone(SEXP t,
+                                        std::unordered_set<SEXP>& seen) {
+        if (TYPEOF(t) == BUILTINSXP || TYPEOF(t) == SPECIALSXP)
+            return true;
+        return TYPEOF(t) == CLOSXP && isValidClosureSEXP(t) &&
+               leavesParentAlone(t, seen);
+    }
+
+    static bool onlyPromiseTargets(CallSite cs) {
+        if (!cs.hasProfile())
+            return false;
+        CallSiteProfile* p = cs.profile();
+        if (p->numTargets == 0 || p->targetsOverflow)
+            return false;
+        for (size_t j = 0; j < p->numTargets; ++j)
+            if (!promiseTarget(p->targets[j]))
+                return false;
+        return true;
+    }
+
+    // What we need to know about the code of the callee
+    struct Scan {
+        bool ok = true;
+        std::unordered_set<SEXP> locals;
+        std::unordered_set<SEXP> used;
+        std::unordered_set<SEXP> guarded;
+        // Symbols used other than by a load in the main code
+        std::unordered_set<SEXP> otherUses;
+        // Symbols used by promises, which might be forced later
+        std::unordered_set<SEXP> promiseUses;
+    };
+
+    // Symbols the caller binds in its environment
+    std::unordered_set<SEXP> callerBindings;
+
+    static SEXP assignTarget(BC bc) {
+        switch (bc.bc) {
+        case BC_t::stvar_:
+        case BC_t::subassign2_:
+        case BC_t::subassign_mat_:
+        case BC_t::subassign2_mat_:
+            return bc.immediateConst();
+        case BC_t::subassign_dollar_:
+        case BC_t::subassign2_name_:
+            return Pool::get(bc.immediate.assign_name.target);
+        default:
+            return R_NilValue;
+        }
+    }
+
+    static void findBindings(CodeEditor& e, std::unordered_set<SEXP>& res) {
+        for (auto bc : e) {
+            SEXP target = assignTarget(bc);
+            if (target != R_NilValue)
+                res.insert(target);
+        }
+        for (size_t i = 0; i < e.numPromises(); ++i)
+            if (e.hasPromise(i))
+                findBindings(e.promise(i), res);
+    }
+
+    static void scan(CodeEditor& e, Scan& s, bool main) {
+        for (auto i = e.begin(); i != e.end(); ++i) {
+            BC bc = *i;
+            switch (bc.bc) {
+            case BC_t::ldvar_:
+            case BC_t::ldarg_:
+                s.used.insert(bc.immediateConst());
+                if (!main)
+                    s.otherUses.insert(bc.immediateConst());
+                break;
+            case BC_t::ldlval_:
+            case BC_t::ldfun_:
+                s.used.insert(bc.immediateConst());
+                s.otherUses.insert(bc.immediateConst());
+                break;
+            case BC_t::guard_fun_: {
+                SEXP name = Pool::get(bc.immediate.guard_fun_args.name);
+                s.used.insert(name);
+                s.guarded.insert(name);
+                if (bc.immediate.guard_fun_args.id != NO_DEOPT_INFO)
+                    s.ok = false;
+                break;
+            }
+            case BC_t::call_:
+            case BC_t::call_pic_: {
+                if (i == e.begin()) {
+                    s.ok = false;
+                    break;
+                }
+                BC fun = *(i - 1);
+                if (!fun.is(BC_t::ldfun_) ||
+                    inspectsFrame(fun.immediateConst()) ||
+                    !onlyPromiseTargets(i.callSite()))
+                    s.ok = false;
+                break;
+            }
+            case BC_t::call_stack_:
+                if (!onlyPromiseTargets(i.callSite()))
+                    s.ok = false;
+                break;
+            case BC_t::static_call_stack_:
+                if (!promiseTarget(i.callSite().target()))
+                    s.ok = false;
+                break;
+            case BC_t::ldddvar_:
+            case BC_t::missing_:
+            case BC_t::return_:
+            case BC_t::close_:
+            case BC_t::guard_env_:
+            case BC_t::int3_:
+            case BC_t::std_generic_:
+            // The ast would not see the renamed locals
+            case BC_t::lazy_:
+                s.ok = false;
+                break;
+            default:
+                break;
+            }
+            SEXP target = assignTarget(bc);
+            if (target != R_NilValue) {
+                s.locals.insert(target);
+                s.otherUses.insert(target);
+            }
+            if (!main && (bc.is(BC_t::ldvar_) || bc.is(BC_t::ldarg_) ||
+                          bc.is(BC_t::ldlval_) || bc.is(BC_t::ldfun_)))
+                s.promiseUses.insert(bc.immediateConst());
+            if (!main && target != R_NilValue)
+                s.promiseUses.insert(target);
+        }
+        for (size_t i = 0; i < e.numPromises(); ++i)
+            if (e.hasPromise(i))
+                scan(e.promise(i), s, false);
+    }
+
+    static void replace(CodeEditor& e, CodeEditor::Iterator i, BC bc) {
+        auto cur = i.asCursor(e);
+        cur.remove();
+        cur << bc;
+    }
+
+    static void rename(CodeEditor& e,
+                       const std::unordered_map<SEXP, SEXP>& names) {
+        for (auto i = e.begin(); i != e.end(); ++i) {
+            BC bc = *i;
+            SEXP sym = R_NilValue;
+            if (bc.is(BC_t::subassign_dollar_) ||
+                bc.is(BC_t::subassign2_name_))
+                sym = Pool::get(bc.immediate.assign_name.target);
+            else if (bc.is(BC_t::ldvar_) || bc.is(BC_t::ldarg_) ||
+                     bc.is(BC_t::ldlval_) || bc.is(BC_t::ldfun_) ||
+                     assignTarget(bc) != R_NilValue)
+                sym = bc.immediateConst();
+            if (!names.count(sym))
+                continue;
+
+            SEXP n = names.at(sym);
+            switch (bc.bc) {
+            case BC_t::ldvar_:
+            case BC_t::ldarg_:
+                replace(e, i, BC::ldvar(n));
+                break;
+            case BC_t::ldlval_:
+                replace(e, i, BC::ldlval(n));
+                break;
+            case BC_t::ldfun_:
+                replace(e, i, BC::ldfun(n));
+                break;
+            case BC_t::stvar_:
+                replace(e, i, BC::stvar(n));
+                break;
+            case BC_t::subassign2_:
+                replace(e, i, BC::subassign2(n));
+                break;
+            case BC_t::subassign_mat_:
+                replace(e, i, BC::subassignMat(n));
+                break;
+            case BC_t::subassign2_mat_:
+                replace(e, i, BC::subassign2Mat(n));
+                break;
+            case BC_t::subassign_dollar_:
+                replace(e, i, BC::subassignDollar(
+                                  n, Pool::get(bc.immediate.assign_name.name)));
+                break;
+            case BC_t::subassign2_name_:
+                replace(e, i, BC::subassign2Name(
+                                  n, Pool::get(bc.immediate.assign_name.name)));
+                break;
+            default:
+                assert(false);
+            }
+        }
+        e.commit();
+        for (size_t i = 0; i < e.numPromises(); ++i)
+            if (e.hasPromise(i))
+                rename(e.promise(i), names);
+    }
+
+    // The same for every copy of fun inlined, the copies never run nested
+    static SEXP inlinedName(SEXP fun, SEXP sym) {
+        std::string name = std::string(".inl.") + CHAR(PRINTNAME(fun)) + "." +
+                           CHAR(PRINTNAME(sym));
+        return Rf_install(name.c_str());
+    }
+
+    // Finds the only load of sym in the main code, provided it is not in a
+    // loop
+    static CodeEditor::Iterator singleUse(CodeEditor& e, SEXP sym) {
+        std::unordered_map<Label, size_t> labels;
+        std::vector<std::pair<Label, size_t>> jumps;
+        std::vector<std::pair<CodeEditor::Iterator, size_t>> uses;
+        size_t idx = 0;
+        for (auto i = e.begin(); i != e.end(); ++i, ++idx) {
+            BC bc = *i;
+            if (bc.is(BC_t::label))
+                labels[bc.immediate.offset] = idx;
+            else if (bc.isJmp())
+                jumps.push_back({bc.immediate.offset, idx});
+            else if (bc.is(BC_t::ldvar_) && bc.immediateConst() == sym)
+                uses.push_back({i, idx});
+        }
+        if (uses.size() != 1)
+            return e.end();
+        size_t use = uses[0].second;
+        for (auto j : jumps) {
+            size_t target = labels.at(j.first);
+            if (target <= use && use <= j.second)
+                return e.end();
+        }
+        return uses[0].first;
+    }
+
+    static bool isConstant(SEXP e) {
+        return e != R_MissingArg && TYPEOF(e) != SYMSXP &&
+               TYPEOF(e) != LANGSXP && TYPEOF(e) != PROMSXP &&
+               TYPEOF(e) != BCODESXP;
+    }
+
+    bool inlineCall(CodeEditor::Iterator ldfun, CallSite cs, SEXP t,
+                    Function* f) {
+        RList formals(FORMALS(t));
+        if (formals.length() < cs.nargs())
+            return false;
+        for (auto a = formals.begin(); a != formals.end(); ++a)
+            if (a.tag() == R_DotsSymbol)
+                return false;
+
+        // Optimized code has guards of its own, which deoptimize into the
+        // callee, thus we inline the original version.
+        CodeEditor edit(f->origin ? f->origin : BODY(t));
+        edit.normalizeForInline();
+
+        Scan s;
+        scan(edit, s, true);
+        if (!s.ok)
+            return false;
+
+        SEXP fun = (*ldfun).immediateConst();
+        std::unordered_map<SEXP, SEXP> names;
+        for (auto a = formals.begin(); a != formals.end(); ++a)
+            s.locals.insert(a.tag());
+        for (auto l : s.locals) {
+            if (s.guarded.count(l))
+                return false;
+            names[l] = inlinedName(fun, l);
+        }
+        // The renamed locals and arguments to remove at the end
+        std::unordered_set<SEXP> unbind;
+        for (auto l : s.locals)
+            if (!s.promiseUses.count(l))
+                unbind.insert(names.at(l));
+        for (auto u : s.used)
+            if (!s.locals.count(u) && callerBindings.count(u))
+                return false;
+
+        // Decide what to do with the arguments, before changing the caller
+        struct Arg {
+            SEXP name;
+            fun_idx_t promise;
+            SEXP value;
+            CodeEditor::Iterator use;
+        };
+        rename(edit, names);
+        std::vector<Arg> args;
+        size_t idx = 0;
+        for (auto a = formals.begin(); a != formals.end(); ++a, ++idx) {
+            // Arguments which are never used are never evaluated
+            if (!s.used.count(a.tag()))
+                continue;
+            SEXP name = names.at(a.tag());
+            auto use = s.otherUses.count(a.tag()) ? edit.end()
+                                                  : singleUse(edit, name);
+            if (idx < cs.nargs()) {
+                args.push_back({name, cs.arg(idx), nullptr, use});
+                continue;
+            }
+            if (*a == R_MissingArg ||
+                (use == edit.end() && !isConstant(*a)))
+                return false;
+            args.push_back({name, MISSING_ARG_IDX, *a, use});
+        }
+
+        std::unordered_set<fun_idx_t> needed;
+        std::vector<Arg> bound;
+        for (auto& a : args) {
+            needed.insert(a.promise);
+            if (a.use == edit.end()) {
+                bound.push_back(a);
+                continue;
+            }
+
+            CodeEditor* arg;
+            if (a.promise != MISSING_ARG_IDX) {
+                arg = code_.detachPromise(a.promise);
+            } else {
+                arg = new CodeEditor(Compiler::compileExpression(a.value).bc);
+                rename(*arg, names);
+            }
+            arg->normalizeForInline();
+            auto cur = a.use.asCursor(edit);
+            cur.remove();
+            cur.insert(*arg);
+            delete arg;
+        }
+        edit.commit();
+
+        for (size_t j = 0; j < cs.nargs(); ++j)
+            if (!needed.count(cs.arg(j)))
+                delete code_.detachPromise(cs.arg(j));
+
+        uint32_t deoptId = Deoptimizer_register((OpcodeT*)ldfun.origin());
+
+        auto cur = ldfun.asCursor(code_);
+        cur.remove();
+        cur.remove();
+        cur << BC::guardName(fun, t, deoptId);
+        for (auto& a : bound) {
+            if (a.promise != MISSING_ARG_IDX)
+                cur << BC::promise(a.promise);
+            else
+                cur << BC::push(a.value);
+            cur << BC::stvar(a.name);
+        }
+        cur.insert(edit);
+        for (auto n : unbind)
+            cur << BC::unbind(n);
+        return true;
+    }
+};
+}
+#endif
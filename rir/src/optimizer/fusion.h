@@ -0,0 +1,188 @@
+#ifndef RIR_OPTIMIZER_FUSION_H
+#define RIR_OPTIMIZER_FUSION_H
+
+#include "ir/CodeEditor.h"
+#include "interpreter/vector_kernels.h"
+#include "R/Protect.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+namespace rir {
+
+/** Replaces expression trees of +, -, * and / by a single fused_arith_.
+ *
+ * The leaves of a tree have to be variable loads or constants. They stay
+ * where they are, together with the guards of the operators, only the
+ * operators themselves are removed and the fused_arith_ takes the place of
+ * the outermost one. Thus the operations run after all leaves are loaded. To
+ * keep the order of promise forcing, errors, warnings and dispatch, a leaf
+ * which comes after an operation has to be a constant or a local known to be
+ * a value (ldlval_). Guards which can deoptimize end a tree, since the
+ * baseline code expects the results of the operations before them. For long double vectors the interpreter then computes
+ * the whole expression in one loop and only allocates the result, otherwise
+ * it falls back to doing the operations one by one.
+ *
+ * A reduce_ (sum, prod, min, max or mean) right after the tree is fused as
+ * well, then already a single operation is worth it, since the elementwise
+ * result is never allocated.
+ *
+ * The program (see vector_kernels.h) is stored in the constant pool, as a
+ * list of the program, the calls of the operations (and the reduction),
+ * which are needed for the fallback, and the reduction or NULL.
+ */
+class ArithFusion {
+  public:
+    CodeEditor& code_;
+
+    ArithFusion(CodeEditor& code) : code_(code) {}
+
+    void run() {
+        std::unordered_set<CodeEditor::Iterator> fused;
+
+        // Going backwards we see the outermost operation of a tree first
+        for (auto i = code_.end(); i != code_.begin();) {
+            --i;
+            if (arithKernel(*i) < 0 || fused.count(i))
+                continue;
+
+            auto pos = i;
+            std::vector<int> program;
+            std::vector<CodeEditor::Iterator> ops;
+            std::vector<bool> values;
+            if (!parse(pos, program, ops, values) || !inOrder(program, values))
+                continue;
+
+            auto next = i + 1;
+            bool reduce = next != code_.end() && isFusedReduction(*next);
+            if (ops.size() < (reduce ? 1 : 2))
+                continue;
+
+            fuse(program, ops, reduce ? next : code_.end());
+            fused.insert(ops.begin(), ops.end());
+        }
+    }
+
+  private:
+    static constexpr int LEAF = MAX_FUSED_LEAVES;
+
+    static int arithKernel(BC bc) {
+        switch (bc.bc) {
+        case BC_t::add_:
+            return KERNEL_ADD;
+        case BC_t::sub_:
+            return KERNEL_SUB;
+        case BC_t::mul_:
+            return KERNEL_MUL;
+        case BC_t::div_:
+            return KERNEL_DIV;
+        default:
+            return -1;
+        }
+    }
+
+    static bool isFusedReduction(BC bc) {
+        if (!bc.is(BC_t::reduce_))
+            return false;
+        switch (bc.immediate.i) {
+        case REDUCE_sum:
+        case REDUCE_prod:
+        case REDUCE_min:
+        case REDUCE_max:
+        case REDUCE_mean:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static bool isLeaf(BC bc) {
+        return bc.is(BC_t::ldvar_) || bc.is(BC_t::ldarg_) ||
+               bc.is(BC_t::ldlval_) || bc.is(BC_t::push_);
+    }
+
+    // Loading it cannot force a promise or fail
+    static bool isValueLeaf(BC bc) {
+        return bc.is(BC_t::ldlval_) || bc.is(BC_t::push_);
+    }
+
+    // In evaluation order, the leaves after the first operation are values
+    static bool inOrder(std::vector<int> const& program,
+                        std::vector<bool> const& values) {
+        bool op = false;
+        size_t leaf = values.size();
+        for (auto i = program.rbegin(); i != program.rend(); ++i) {
+            if (*i != LEAF)
+                op = true;
+            else if (!values[--leaf] && op)
+                return false;
+        }
+        return true;
+    }
+
+    // Parses the expression whose value is pushed by the instruction at pos
+    // and moves pos in front of it. The program, the operations and whether
+    // the leaves are values are collected in reverse order.
+    bool parse(CodeEditor::Iterator& pos, std::vector<int>& program,
+               std::vector<CodeEditor::Iterator>& ops,
+               std::vector<bool>& values) {
+        while ((*pos).is(BC_t::guard_fun_)) {
+            if ((*pos).immediate.guard_fun_args.id != NO_DEOPT_INFO)
+                return false;
+            --pos;
+        }
+
+        if (isLeaf(*pos)) {
+            program.push_back(LEAF);
+            values.push_back(isValueLeaf(*pos));
+            --pos;
+            return true;
+        }
+
+        int kernel = arithKernel(*pos);
+        if (kernel < 0 || ops.size() + 1 == MAX_FUSED_LEAVES)
+            return false;
+        program.push_back(FUSED_OP(kernel));
+        ops.push_back(pos);
+        --pos;
+        // rhs first, we are going backwards
+        return parse(pos, program, ops, values) &&
+               parse(pos, program, ops, values);
+    }
+
+    void fuse(std::vector<int>& program, std::vector<CodeEditor::Iterator>& ops,
+              CodeEditor::Iterator reduction) {
+        bool reduce = reduction != code_.end();
+        std::reverse(program.begin(), program.end());
+        std::reverse(ops.begin(), ops.end());
+
+        Protect p;
+        SEXP code = p(Rf_allocVector(INTSXP, program.size()));
+        int leaves = 0;
+        for (size_t i = 0; i < program.size(); ++i)
+            INTEGER(code)[i] = program[i] == LEAF ? leaves++ : program[i];
+
+        if (reduce)
+            ops.push_back(reduction);
+        SEXP calls = p(Rf_allocVector(VECSXP, ops.size()));
+        for (size_t i = 0; i < ops.size(); ++i) {
+            SEXP call = ops[i].src();
+            SET_VECTOR_ELT(calls, i, call ? call : R_NilValue);
+        }
+
+        SEXP fused = p(Rf_allocVector(VECSXP, 3));
+        SET_VECTOR_ELT(fused, 0, code);
+        SET_VECTOR_ELT(fused, 1, calls);
+        SET_VECTOR_ELT(fused, 2,
+                       reduce ? Rf_ScalarInteger((*reduction).immediate.i)
+                              : R_NilValue);
+
+        for (size_t i = 0; i < ops.size() - 1; ++i)
+            ops[i].asCursor(code_).remove();
+        auto cur = ops.back().asCursor(code_);
+        cur.remove();
+        cur << BC::fusedArith(fused, leaves);
+    }
+};
+}
+#endif
@@ -0,0 +1,72 @@
+#ifndef RIR_OPTIMIZER_INLINE_CACHE_H
+#define RIR_OPTIMIZER_INLINE_CACHE_H
+
+#include "ir/CodeEditor.h"
+#include "interpreter/runtime.h"
+#include "R/Protect.h"
+#include "utils/Pool.h"
+
+#include <cstring>
+
+namespace rir {
+
+/** Turns call sites which only ever called a few rir closures into
+ * call_pic_, with the profiled closures as the inline cache of the site.
+ *
+ * If the callee is one of the cached closures the interpreter calls it
+ * directly, everything else (other closures, builtins, specials) takes the
+ * generic path of call_. Since the promises of the call site stay the same,
+ * this is just a matter of replacing the instruction and its call site.
+ */
+class InlineCaches {
+  public:
+    CodeEditor& code_;
+
+    InlineCaches(CodeEditor& code) : code_(code) {}
+
+    void run() {
+        for (auto i = code_.begin(); i != code_.end(); ++i) {
+            if (!(*i).is(BC_t::call_))
+                continue;
+
+            CallSite cs = i.callSite();
+            if (!cs.hasProfile())
+                continue;
+
+            CallSiteProfile* p = cs.profile();
+            if (p->numTargets == 0 || p->targetsOverflow)
+                continue;
+
+            bool cachable = true;
+            for (size_t j = 0; j < p->numTargets; ++j) {
+                SEXP t = p->targets[j];
+                if (TYPEOF(t) != CLOSXP || !isValidClosureSEXP(t))
+                    cachable = false;
+            }
+            if (!cachable)
+                continue;
+
+            CallSiteStruct* cached = cachedCallSite(cs, p);
+            CodeEditor::Cursor cur = i.asCursor(code_);
+            cur.remove();
+            cur.insertCall(BC::callPic(cs.nargs()), cached);
+        }
+    }
+
+  private:
+    static CallSiteStruct* cachedCallSite(CallSite cs, CallSiteProfile* p) {
+        unsigned needed = CallSite_sizeOf(cs.cs);
+        CallSiteStruct* res = (CallSiteStruct*)new char[needed];
+        memcpy(res, cs.cs, needed);
+
+        Protect protect;
+        SEXP cache = protect(Rf_allocVector(VECSXP, p->numTargets));
+        for (size_t j = 0; j < p->numTargets; ++j)
+            SET_VECTOR_ELT(cache, j, p->targets[j]);
+        res->hasInlineCache = true;
+        res->trg = Pool::insert(cache);
+        return res;
+    }
+};
+}
+#endif
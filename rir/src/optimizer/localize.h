@@ -21,6 +21,7 @@ class Localizer : public InstructionDispatcher::Receiver {
     void asbool_(CodeEditor::Iterator ins) override { lastCall = ins; }
 
     void call_(CodeEditor::Iterator ins) override { lastCall = ins; }
+    void call_pic_(CodeEditor::Iterator ins) override { lastCall = ins; }
 
     void dispatch_(CodeEditor::Iterator ins) override { lastCall = ins; }
 
@@ -28,6 +29,8 @@ class Localizer : public InstructionDispatcher::Receiver {
 
     void dispatch_stack_(CodeEditor::Iterator ins) override { lastCall = ins; }
 
+    void std_generic_(CodeEditor::Iterator ins) override { lastCall = ins; }
+
     void static_call_stack_(CodeEditor::Iterator ins) override {
         lastCall = ins;
     }
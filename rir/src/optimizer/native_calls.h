@@ -0,0 +1,93 @@
+#ifndef RIR_NATIVE_CALLS_H
+#define RIR_NATIVE_CALLS_H
+
+#include "ir/CodeEditor.h"
+#include "interpreter/deoptimizer.h"
+#include "interpreter/native_builtins.h"
+#include "utils/Pool.h"
+
+#include <cstring>
+
+namespace rir {
+
+/** Turns calls which always went to the same builtin into static stack
+ * calls, for which the interpreter uses the native version of the builtin
+ * (see native_builtins.h) instead of building the argument list.
+ *
+ * Builtins evaluate all their arguments anyway, therefore the promises are
+ * inlined in order.
+ *
+ * If the name gets bound to something else, the guard deoptimizes to the
+ * ldfun_ of the original code, thus only calls from the original code are
+ * rewritten.
+ */
+class NativeCalls {
+  public:
+    CodeEditor& code_;
+
+    NativeCalls(CodeEditor& code) : code_(code) {}
+
+    void run() {
+        for (auto i = code_.begin(); i != code_.end(); ++i) {
+            if (!(*i).is(BC_t::call_))
+                continue;
+
+            CallSite cs = i.callSite();
+            if (cs.hasNames() || !cs.hasProfile())
+                continue;
+
+            CallSiteProfile* p = cs.profile();
+            if (p->taken < 50 || p->numTargets != 1)
+                continue;
+
+            SEXP t = p->targets[0];
+            if (TYPEOF(t) != BUILTINSXP || !nativeBuiltin(t))
+                continue;
+
+            bool plainArgs = true;
+            for (size_t j = 0; j < cs.nargs(); ++j)
+                if (cs.arg(j) == DOTS_ARG_IDX || cs.arg(j) == MISSING_ARG_IDX)
+                    plainArgs = false;
+            if (!plainArgs)
+                continue;
+
+            auto ldfun = i - 1;
+            if (!(*ldfun).is(BC_t::ldfun_) || !ldfun.hasOrigin())
+                continue;
+            SEXP name = (*ldfun).immediateConst();
+            uint32_t deoptId =
+                Deoptimizer_register((OpcodeT*)ldfun.origin());
+
+            std::vector<CodeEditor*> args;
+            for (size_t j = 0; j < cs.nargs(); ++j)
+                args.push_back(code_.detachPromise(cs.arg(j)));
+
+            CallSiteStruct* target = staticCallSite(cs, t);
+
+            CodeEditor::Cursor cur = ldfun.asCursor(code_);
+            cur.remove();
+            cur.remove();
+            cur << BC::guardName(name, t, deoptId);
+            for (auto a : args) {
+                a->normalizeForInline();
+                cur.insert(*a);
+                delete a;
+            }
+            cur.insertCall(BC::staticCallStack(cs.nargs()), target);
+        }
+    }
+
+  private:
+    static CallSiteStruct* staticCallSite(CallSite cs, SEXP target) {
+        unsigned needed = CallSite_size(false, false, false, false, cs.nargs());
+        CallSiteStruct* res = (CallSiteStruct*)new char[needed];
+        memset(res, 0, needed);
+        res->call = cs.cs->call;
+        res->nargs = cs.nargs();
+        res->hasTarget = true;
+        *CallSite_target(res) = Pool::insert(target);
+        return res;
+    }
+};
+}
+#endif
@@ -5,6 +5,7 @@
 #include "code/analysis.h"
 #include "code/dispatchers.h"
 #include "code/dataflow.h"
+#include "interpreter/deoptimizer.h"
 #include "interpreter/interp_context.h"
 #include "ir/Compiler.h"
 #include "R/RList.h"
@@ -92,6 +93,13 @@ class StupidInliner {
             if (cs.hasNames())
                 continue;
 
+            bool plainArgs = true;
+            for (size_t j = 0; j < cs.nargs(); ++j)
+                if (cs.arg(j) == DOTS_ARG_IDX || cs.arg(j) == MISSING_ARG_IDX)
+                    plainArgs = false;
+            if (!plainArgs)
+                continue;
+
             if (!cs.hasProfile())
                 continue;
 
@@ -149,12 +157,19 @@ class StupidInliner {
                 ++idx;
             }
 
+            // Without the original code there is no way back
+            auto ldfun = i - 1;
+            uint32_t deoptId =
+                ldfun.hasOrigin()
+                    ? Deoptimizer_register((OpcodeT*)ldfun.origin())
+                    : NO_DEOPT_INFO;
+
             cur.remove();
             cur.remove();
             if (cur.bc().is(BC_t::guard_env_))
                 cur.remove();
 
-            cur << BC::guardName(name, t);
+            cur << BC::guardName(name, t, deoptId);
 
             doInline(cur, t, args);
 
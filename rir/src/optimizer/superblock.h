@@ -0,0 +1,170 @@
+#ifndef RIR_OPTIMIZER_SUPERBLOCK_H
+#define RIR_OPTIMIZER_SUPERBLOCK_H
+
+#include "ir/CodeEditor.h"
+#include "interpreter/trace.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace rir {
+
+/** Copies the path the trace of a hot loop took (see interpreter/trace.h)
+ * into a superblock at the end of the code, and points the back edges of the
+ * loop to it. Thus after the first iteration the loop runs the superblock.
+ *
+ * The superblock has no branches into it, every forward jump of the path is
+ * followed and every conditional branch becomes a side exit to the original
+ * loop body, which then jumps back to the superblock at its end. Since both
+ * are the same code, the stack and the environment at a side exit are those
+ * the original code expects. A branch the trace did not see is assumed not
+ * to be taken.
+ *
+ * The copies quicken on their own (see extract1_real_), for the
+ * types the hot path sees, and the calls get their own call sites with fresh
+ * dispatch and inline caches (see CodeEditor::Cursor::insertCopy).
+ *
+ * Loops containing loops or leaving the function are left alone.
+ */
+class Superblock {
+  public:
+    CodeEditor& code_;
+    Trace const& trace_;
+
+    // Inlined calls make the path longer than what the trace saw
+    static constexpr size_t MAX_LENGTH = 1024;
+
+    Superblock(CodeEditor& code, Trace const& trace)
+        : code_(code), trace_(trace) {}
+
+    void run() {
+        auto backEdge = findBackEdge();
+        if (backEdge == code_.end())
+            return;
+        if (!(*(code_.end() - 1)).is(BC_t::ret_))
+            return;
+        Label header = (*backEdge).immediate.offset;
+
+        std::unordered_map<OpcodeT*, bool> taken;
+        for (unsigned j = 0; j < trace_.length; ++j)
+            taken.emplace(trace_.branches[j].pc, trace_.branches[j].taken);
+
+        // First the path, such that we can still give up without changes
+        std::vector<Step> path;
+        auto i = code_.target(*backEdge);
+        while (true) {
+            if (i == code_.end() || path.size() == MAX_LENGTH)
+                return;
+            BC bc = *i;
+            if (bc.is(BC_t::label)) {
+                ++i;
+                continue;
+            }
+            if (bc.is(BC_t::br_)) {
+                if (bc.immediate.offset == header)
+                    break;
+                i = code_.target(bc);
+                continue;
+            }
+            if (bc.is(BC_t::brtrue_) || bc.is(BC_t::brfalse_) ||
+                bc.is(BC_t::brobj_)) {
+                if (bc.immediate.offset == header)
+                    return;
+                auto t = taken.find(origin(i));
+                if (t != taken.end() && t->second) {
+                    path.push_back(Step(Step::Taken, i));
+                    i = code_.target(bc);
+                } else {
+                    path.push_back(Step(Step::Copy, i));
+                    ++i;
+                }
+                continue;
+            }
+            if (bc.isJmp() || bc.is(BC_t::endcontext_) || bc.is(BC_t::ret_) ||
+                bc.is(BC_t::return_))
+                return;
+            path.push_back(Step(Step::Copy, i));
+            ++i;
+        }
+
+        Label start = code_.mkLabel();
+        CodeEditor::Cursor out = code_.end().asCursor(code_);
+        out << start;
+        for (auto s : path) {
+            if (s.kind == Step::Copy) {
+                // A branch which was not taken exits to its original target
+                out.insertCopy(s.pos);
+                continue;
+            }
+            BC bc = *s.pos;
+            Label fallthrough = code_.mkLabel();
+            (s.pos + 1).asCursor(code_) << fallthrough;
+            if (invertible(s.pos)) {
+                out << (bc.is(BC_t::brtrue_) ? BC::brfalse(fallthrough)
+                                             : BC::brtrue(fallthrough));
+            } else {
+                Label stay = code_.mkLabel();
+                out << branch(bc.bc, stay) << BC::br(fallthrough) << stay;
+            }
+        }
+        out << BC::br(start);
+
+        for (auto j = code_.begin(); j != code_.end(); ++j) {
+            if ((*j).is(BC_t::br_) && (*j).immediate.offset == header) {
+                CodeEditor::Cursor cur = j.asCursor(code_);
+                cur.remove();
+                cur << BC::br(start);
+            }
+        }
+    }
+
+  private:
+    struct Step {
+        enum Kind { Copy, Taken };
+        Kind kind;
+        CodeEditor::Iterator pos;
+        Step(Kind kind, CodeEditor::Iterator pos) : kind(kind), pos(pos) {}
+    };
+
+    CodeEditor::Iterator findBackEdge() {
+        for (auto i = code_.begin(); i != code_.end(); ++i)
+            if ((*i).is(BC_t::br_) && origin(i) == trace_.backEdge)
+                return i;
+        return code_.end();
+    }
+
+    // At a jump target the editor keeps the origin with the label
+    static OpcodeT* origin(CodeEditor::Iterator i) {
+        if (i.hasOrigin())
+            return (OpcodeT*)i.origin();
+        auto label = i - 1;
+        if ((*label).is(BC_t::label) && label.hasOrigin())
+            return (OpcodeT*)label.origin();
+        return nullptr;
+    }
+
+    // asbool_ leaves either TRUE or FALSE, then brtrue_ and brfalse_ are
+    // the opposites of each other
+    static bool invertible(CodeEditor::Iterator branch) {
+        BC bc = *branch;
+        if (!bc.is(BC_t::brtrue_) && !bc.is(BC_t::brfalse_))
+            return false;
+        return (*(branch - 1)).is(BC_t::asbool_);
+    }
+
+    static BC branch(BC_t op, Label target) {
+        switch (op) {
+        case BC_t::brtrue_:
+            return BC::brtrue(target);
+        case BC_t::brfalse_:
+            return BC::brfalse(target);
+        case BC_t::brobj_:
+            return BC::brobj(target);
+        default:
+            assert(false);
+            return BC::br(target);
+        }
+    }
+};
+}
+#endif
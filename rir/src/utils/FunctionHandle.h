@@ -44,6 +44,7 @@ class FunctionHandle {
         function->foffset = 0;
         function->invocationCount = 0;
         function->markOpt = false;
+        function->traced = false;
 
         return FunctionHandle(store);
     }